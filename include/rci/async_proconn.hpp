@@ -0,0 +1,303 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_ASYNC_PROCONN_HPP
+#define RCI_ASYNC_PROCONN_HPP
+
+// Header only, so the library itself keeps building as C++11
+#if __cplusplus < 202002L
+#error "rci/async_proconn.hpp requires C++20"
+#endif
+
+#include <algorithm>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "rci/proconn.hpp"
+
+namespace rci {
+
+// A proc connector listener for C++20 coroutines.
+// Any number of coroutines subscribe, and co_await their events one at a
+// time, with no thread of their own:
+//
+//     auto sub = apc.subscribe();
+//     while (auto evt = co_await sub.next())
+//     {
+//         ...
+//     }
+//
+// The listener is driven by the caller's event loop: Whenever fd() is
+// readable, call process_pending(), which queues the events for every
+// interested subscription and resumes the coroutines waiting for them,
+// inline, on the calling thread. Not thread-safe.
+class async_proconn
+{
+public:
+    typedef proconn::event event;
+
+private:
+    // Shared by a subscription and the listener, so either can go first
+    struct state
+    {
+        uint32_t mask;
+        size_t capacity;
+        std::deque<event> events;
+        uint64_t dropped = 0;
+
+        std::coroutine_handle<> waiter;
+        bool scheduled = false; // Waiter queued to be resumed
+        bool closed    = false; // No more events will be queued
+        bool cancelled = false; // The subscription is gone
+    };
+
+public:
+    // Awaits the next event of a subscription, or std::nullopt once the
+    // listener is closed and the queued events were consumed
+    class next_awaiter
+    {
+    public:
+        bool await_ready() const noexcept
+        {
+            return !_state->events.empty() || _state->closed;
+        }
+
+        void await_suspend(std::coroutine_handle<> waiter) noexcept
+        {
+            _state->waiter = waiter;
+        }
+
+        std::optional<event> await_resume()
+        {
+            if (_state->events.empty())
+            {
+                return std::nullopt;
+            }
+
+            event evt = _state->events.front();
+            _state->events.pop_front();
+            return evt;
+        }
+
+    private:
+        friend class async_proconn;
+
+        explicit next_awaiter(state* target) : _state(target) {}
+
+        state* _state;
+    };
+
+    // The events of a single consumer. A single coroutine at a time may
+    // await next().
+    class subscription
+    {
+    public:
+        subscription(subscription&&) = default;
+
+        // Cancels the subscription being replaced
+        subscription& operator=(subscription&& other)
+        {
+            if (this != &other)
+            {
+                if (_state)
+                {
+                    _state->cancelled = true;
+                }
+                _state = std::move(other._state);
+            }
+            return *this;
+        }
+
+        ~subscription()
+        {
+            if (_state)
+            {
+                _state->cancelled = true;
+            }
+        }
+
+        next_awaiter next() { return next_awaiter(_state.get()); }
+
+        // Events queued and not awaited yet
+        size_t pending() const { return _state->events.size(); }
+
+        // Oldest events dropped as the queue was full
+        uint64_t dropped() const { return _state->dropped; }
+
+    private:
+        friend class async_proconn;
+
+        explicit subscription(std::shared_ptr<state> target)
+            : _state(std::move(target))
+        {}
+
+        std::shared_ptr<state> _state;
+    };
+
+public:
+    async_proconn() : async_proconn(proconn::options()) {}
+
+    explicit async_proconn(const proconn::options& opts)
+        : _proconn(build_callbacks(), opts)
+    {}
+
+    async_proconn(const async_proconn&) = delete;
+    async_proconn& operator=(const async_proconn&) = delete;
+
+    ~async_proconn() { close(); }
+
+    // Receive events of the given types, as a mask of event_type values.
+    // Up to capacity events are queued for the subscription, beyond that
+    // its oldest events are dropped.
+    subscription subscribe(uint32_t mask   = proconn::ALL_EVENTS,
+                           size_t capacity = 1024)
+    {
+        auto target      = std::make_shared<state>();
+        target->mask     = mask;
+        target->capacity = capacity ? capacity : 1;
+        target->closed   = _closed;
+
+        _subscriptions.push_back(target);
+        return subscription(std::move(target));
+    }
+
+    void start() { _proconn.start(); }
+
+    // Readable whenever events are pending
+    int fd() const { return _proconn.fd(); }
+
+    // Dispatch up to max_events pending events, and resume the coroutines
+    // waiting for them. Returns the number of events dispatched.
+    size_t process_pending(size_t max_events = 1024)
+    {
+        size_t events = _proconn.process_pending(max_events);
+        resume_ready();
+        return events;
+    }
+
+    // Unregister from the kernel, and resume every waiting coroutine with
+    // std::nullopt, once its queued events were consumed
+    void close()
+    {
+        if (_closed)
+        {
+            return;
+        }
+
+        _closed = true;
+        _proconn.stop();
+
+        for (auto& target : _subscriptions)
+        {
+            target->closed = true;
+            schedule(target);
+        }
+        resume_ready();
+    }
+
+    proconn& listener() { return _proconn; }
+
+private:
+    proconn::event_callbacks build_callbacks()
+    {
+        proconn::event_callbacks callbacks;
+        callbacks.any = [this](const event& evt) { publish(evt); };
+        return callbacks;
+    }
+
+    void publish(const event& evt)
+    {
+        bool cancelled = false;
+        for (auto& target : _subscriptions)
+        {
+            cancelled = cancelled || target->cancelled;
+            if (target->cancelled ||
+                !(target->mask & static_cast<uint32_t>(evt.type)))
+            {
+                continue;
+            }
+
+            if (target->events.size() >= target->capacity)
+            {
+                target->events.pop_front();
+                ++target->dropped;
+            }
+
+            target->events.push_back(evt);
+            schedule(target);
+        }
+
+        if (cancelled)
+        {
+            prune();
+        }
+    }
+
+    void schedule(const std::shared_ptr<state>& target)
+    {
+        if (target->waiter && !target->scheduled)
+        {
+            target->scheduled = true;
+            _ready.push_back(target);
+        }
+    }
+
+    // Resumed coroutines may subscribe or await again, so resume a copy
+    void resume_ready()
+    {
+        while (!_ready.empty())
+        {
+            std::vector<std::shared_ptr<state>> ready;
+            ready.swap(_ready);
+
+            for (auto& target : ready)
+            {
+                target->scheduled = false;
+                auto waiter = std::exchange(target->waiter, nullptr);
+                if (waiter && !target->cancelled)
+                {
+                    waiter.resume();
+                }
+            }
+        }
+    }
+
+    void prune()
+    {
+        auto end = std::remove_if(
+            _subscriptions.begin(), _subscriptions.end(),
+            [](const std::shared_ptr<state>& target) {
+                return target->cancelled;
+            });
+        _subscriptions.erase(end, _subscriptions.end());
+    }
+
+private:
+    proconn _proconn;
+    bool _closed = false;
+
+    std::vector<std::shared_ptr<state>> _subscriptions;
+    std::vector<std::shared_ptr<state>> _ready;
+};
+
+} // namespace rci
+
+#endif // RCI_ASYNC_PROCONN_HPP
@@ -0,0 +1,354 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_BASIC_PROCONN_HPP
+#define RCI_BASIC_PROCONN_HPP
+
+#include <cstdint>
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "rci/proconn_base.hpp"
+
+namespace rci {
+namespace impl {
+
+// Defines handles_<method><H>, true if H has a method callable with the
+// given argument types, names_<method><H>, true if H has a method of that
+// name at all, and call_<method>(h, args..., tag), which calls it only if
+// the tag is std::true_type, and otherwise compiles to nothing.
+#define RCI_PROCONN_HANDLER_METHOD(method, ...)                               \
+    template <typename H>                                                     \
+    struct handles_##method                                                   \
+    {                                                                         \
+    private:                                                                  \
+        template <typename T, typename... A>                                  \
+        static std::true_type test(decltype(std::declval<T&>().method(        \
+            std::declval<A>()...))*);                                         \
+                                                                              \
+        template <typename T, typename... A>                                  \
+        static std::false_type test(...);                                     \
+                                                                              \
+    public:                                                                   \
+        static constexpr bool value =                                         \
+            decltype(test<H, __VA_ARGS__>(nullptr))::value;                   \
+    };                                                                        \
+                                                                              \
+    template <typename H>                                                     \
+    struct names_##method                                                     \
+    {                                                                         \
+    private:                                                                  \
+        template <typename T>                                                 \
+        static std::true_type test(decltype(&T::method)*);                    \
+                                                                              \
+        template <typename T>                                                 \
+        static std::false_type test(...);                                     \
+                                                                              \
+    public:                                                                   \
+        static constexpr bool value = decltype(test<H>(nullptr))::value;      \
+    };                                                                        \
+                                                                              \
+    template <typename H, typename... Args>                                   \
+    inline void call_##method(H& handler, std::true_type, Args&&... args)     \
+    {                                                                         \
+        handler.method(std::forward<Args>(args)...);                          \
+    }                                                                         \
+                                                                              \
+    template <typename H, typename... Args>                                   \
+    inline void call_##method(H&, std::false_type, Args&&...)                 \
+    {}
+
+RCI_PROCONN_HANDLER_METHOD(on_fork, const proconn_base::fork_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_exec, const proconn_base::exec_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_uid, const proconn_base::uid_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_gid, const proconn_base::gid_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_sid, const proconn_base::sid_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_ptrace, const proconn_base::ptrace_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_comm, const proconn_base::comm_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_coredump,
+                           const proconn_base::coredump_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_exit, const proconn_base::exit_event_view&)
+RCI_PROCONN_HANDLER_METHOD(on_lost, uint64_t)
+RCI_PROCONN_HANDLER_METHOD(on_gap, uint32_t, uint64_t)
+RCI_PROCONN_HANDLER_METHOD(on_event, const proconn_base::event&)
+RCI_PROCONN_HANDLER_METHOD(on_batch, const proconn_base::event*, size_t)
+
+#undef RCI_PROCONN_HANDLER_METHOD
+
+} // namespace impl
+
+// A proc connector listener that calls its handler directly, with no type
+// erasure, so that the handler methods can be inlined.
+//
+// The handler implements any subset of:
+//   void on_fork(const fork_event_view& event);
+//   void on_exec(const exec_event_view& event);
+//   void on_uid(const uid_event_view& event);
+//   void on_gid(const gid_event_view& event);
+//   void on_sid(const sid_event_view& event);
+//   void on_ptrace(const ptrace_event_view& event);
+//   void on_comm(const comm_event_view& event);
+//   void on_coredump(const coredump_event_view& event);
+//   void on_exit(const exit_event_view& event);
+//   void on_lost(uint64_t overruns);
+//   void on_gap(uint32_t cpu, uint64_t missed);
+//   void on_event(const event& event);
+//   void on_batch(const event* first, size_t count);
+//
+// Methods named like these that can't be called with these arguments fail
+// to compile, rather than being ignored.
+// Which event types are handled is decided at compile time: Branches for
+// unhandled types compile away, and with options::kernel_filter (set by the
+// default options) the kernel only sends the handled types.
+// on_event and on_batch receive every event type, decoded into a tagged
+// event. on_batch is called once per receive, with a reused array that is
+// only valid during the call.
+template <typename Handler>
+class basic_proconn final : public impl::proconn_base
+{
+private:
+    static constexpr uint32_t event_bit(bool handled, uint32_t what)
+    {
+        return handled ? what : 0;
+    }
+
+public:
+    // proc_event::what values of the event types the handler implements
+    static constexpr uint32_t EVENT_MASK =
+        event_bit(impl::handles_on_fork<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_FORK) |
+        event_bit(impl::handles_on_exec<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_EXEC) |
+        event_bit(impl::handles_on_uid<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_UID) |
+        event_bit(impl::handles_on_gid<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_GID) |
+        event_bit(impl::handles_on_sid<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_SID) |
+        event_bit(impl::handles_on_ptrace<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_PTRACE) |
+        event_bit(impl::handles_on_comm<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_COMM) |
+        event_bit(impl::handles_on_coredump<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_COREDUMP) |
+        event_bit(impl::handles_on_exit<Handler>::value,
+                  impl::proconn_event::PROC_EVENT_EXIT) |
+        event_bit(impl::handles_on_event<Handler>::value ||
+                      impl::handles_on_batch<Handler>::value,
+                  ALL_EVENTS);
+
+    static_assert(EVENT_MASK != 0, "Handler doesn't handle any event type");
+
+    // A handler method with the wrong signature would be silently ignored
+#define RCI_PROCONN_CHECK_HANDLER(method, signature)                          \
+    static_assert(!impl::names_##method<Handler>::value ||                    \
+                      impl::handles_##method<Handler>::value,                 \
+                  "Handler::" #method " must be callable as " signature)
+
+    RCI_PROCONN_CHECK_HANDLER(on_fork, "on_fork(const fork_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_exec, "on_exec(const exec_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_uid, "on_uid(const uid_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_gid, "on_gid(const gid_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_sid, "on_sid(const sid_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_ptrace,
+                              "on_ptrace(const ptrace_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_comm, "on_comm(const comm_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_coredump,
+                              "on_coredump(const coredump_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_exit, "on_exit(const exit_event_view&)");
+    RCI_PROCONN_CHECK_HANDLER(on_lost, "on_lost(uint64_t)");
+    RCI_PROCONN_CHECK_HANDLER(on_gap, "on_gap(uint32_t, uint64_t)");
+    RCI_PROCONN_CHECK_HANDLER(on_event, "on_event(const event&)");
+    RCI_PROCONN_CHECK_HANDLER(on_batch, "on_batch(const event*, size_t)");
+
+#undef RCI_PROCONN_CHECK_HANDLER
+
+public:
+    explicit basic_proconn(Handler handler,
+                           const options& opts = default_options())
+        : proconn_base(opts, EVENT_MASK), _handler(std::move(handler))
+    {}
+
+    // Blocks, dispatching events, until stop() is called
+    void run()
+    {
+        receive_loop([this](const raw_event* events, size_t count) {
+            dispatch(events, count);
+        });
+    }
+
+    // Dispatch up to max_events pending events without blocking.
+    // Returns the number of events dispatched, 0 if none were pending.
+    size_t process_pending(size_t max_events = 1024)
+    {
+        return receive_pending(max_events,
+                               [this](const raw_event* events, size_t count) {
+                                   dispatch(events, count);
+                               });
+    }
+
+    Handler& handler() { return _handler; }
+    const Handler& handler() const { return _handler; }
+
+    // The options used when none are given: Filter in the kernel
+    static options default_options()
+    {
+        options opts;
+        opts.kernel_filter = true;
+        return opts;
+    }
+
+private:
+    template <typename H>
+    using handles = std::integral_constant<bool, H::value>;
+
+    void on_lost(uint64_t overruns) override
+    {
+        impl::call_on_lost(_handler, handles<impl::handles_on_lost<Handler>>(),
+                           overruns);
+    }
+
+    void on_gap(uint32_t cpu, uint64_t missed) override
+    {
+        impl::call_on_gap(_handler, handles<impl::handles_on_gap<Handler>>(),
+                          cpu, missed);
+    }
+
+    void dispatch(const raw_event* events, size_t count)
+    {
+        dispatch_decoded(
+            events, count,
+            std::integral_constant<bool,
+                                   impl::handles_on_event<Handler>::value ||
+                                       impl::handles_on_batch<Handler>::value>());
+    }
+
+    // Each event reaches its own method and then on_event
+    void dispatch_decoded(const raw_event* events, size_t count,
+                          std::true_type)
+    {
+        _decoded.resize(count);
+
+        size_t decoded = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            dispatch_event(events[i]);
+            if (decode(events[i], _decoded[decoded]))
+            {
+                impl::call_on_event(_handler,
+                                    handles<impl::handles_on_event<Handler>>(),
+                                    _decoded[decoded]);
+                ++decoded;
+            }
+        }
+
+        if (decoded)
+        {
+            impl::call_on_batch(_handler,
+                                handles<impl::handles_on_batch<Handler>>(),
+                                _decoded.data(), decoded);
+        }
+    }
+
+    void dispatch_decoded(const raw_event* events, size_t count,
+                          std::false_type)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            dispatch_event(events[i]);
+        }
+    }
+
+    void dispatch_event(const raw_event& event)
+    {
+        using impl::proconn_event;
+
+        auto evt = event.data;
+        auto len = event.len;
+        switch (evt->what)
+        {
+            case proconn_event::PROC_EVENT_FORK:
+                impl::call_on_fork(_handler,
+                                   handles<impl::handles_on_fork<Handler>>(),
+                                   fork_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_EXEC:
+                impl::call_on_exec(_handler,
+                                   handles<impl::handles_on_exec<Handler>>(),
+                                   exec_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_UID:
+                impl::call_on_uid(_handler,
+                                  handles<impl::handles_on_uid<Handler>>(),
+                                  uid_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_GID:
+                impl::call_on_gid(_handler,
+                                  handles<impl::handles_on_gid<Handler>>(),
+                                  gid_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_SID:
+                impl::call_on_sid(_handler,
+                                  handles<impl::handles_on_sid<Handler>>(),
+                                  sid_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_PTRACE:
+                impl::call_on_ptrace(
+                    _handler, handles<impl::handles_on_ptrace<Handler>>(),
+                    ptrace_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_COMM:
+                impl::call_on_comm(_handler,
+                                   handles<impl::handles_on_comm<Handler>>(),
+                                   comm_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_COREDUMP:
+                impl::call_on_coredump(
+                    _handler, handles<impl::handles_on_coredump<Handler>>(),
+                    coredump_event_view(evt, len));
+                break;
+
+            case proconn_event::PROC_EVENT_EXIT:
+                impl::call_on_exit(_handler,
+                                   handles<impl::handles_on_exit<Handler>>(),
+                                   exit_event_view(evt, len));
+                break;
+
+            default:
+                break;
+        }
+    }
+
+private:
+    Handler _handler;
+    std::vector<event> _decoded;
+};
+
+template <typename Handler>
+constexpr uint32_t basic_proconn<Handler>::EVENT_MASK;
+
+} // namespace rci
+
+#endif // RCI_BASIC_PROCONN_HPP
@@ -0,0 +1,134 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_BROADCAST_PROCONN_HPP
+#define RCI_BROADCAST_PROCONN_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rci/broadcast_ring.hpp"
+#include "rci/notifier.hpp"
+#include "rci/proconn.hpp"
+#include "rci/proconn_base.hpp"
+
+namespace rci {
+
+// A proc connector listener feeding several independent consumers from a
+// single socket: run() publishes every event once into a shared ring, and
+// every consumer reads all of it on a thread of its own, through a cursor
+// of its own. A slow consumer either holds back the publishing, or loses
+// its own oldest events, depending on its policy. Either way, the other
+// consumers are unaffected by it.
+//
+// The lost and gap callbacks of the first consumer are called on the
+// thread calling run().
+class broadcast_proconn final : public impl::proconn_base
+{
+public:
+    typedef proconn::event_callbacks event_callbacks;
+
+    struct consumer
+    {
+        event_callbacks callbacks;
+        broadcast_policy policy = broadcast_policy::block;
+    };
+
+    struct consumer_stats
+    {
+        uint64_t delivered; // Events handed to the callbacks
+        uint64_t lost;      // Events overwritten before being read
+        uint64_t lag;       // Events published but not read yet
+    };
+
+    struct ring_stats
+    {
+        size_t capacity;    // Number of events the ring holds
+        uint64_t published; // Events published so far
+        uint64_t blocked;   // Times publishing waited for a consumer
+    };
+
+public:
+    // capacity is the number of events the ring holds
+    explicit broadcast_proconn(std::vector<consumer> consumers);
+    broadcast_proconn(std::vector<consumer> consumers, const options& opts,
+                      size_t capacity = 4096);
+    ~broadcast_proconn();
+
+    // Start a thread per consumer, and publish events on the calling thread
+    // until stop() is called. Rethrows the first error of any thread, which
+    // stops the listener.
+    void run();
+
+    // Makes run() return at once, and stops the consumer threads.
+    // Events not read yet are discarded. Safe to call from any thread.
+    void stop();
+
+    // Safe to call from any thread
+    ring_stats ring_statistics() const;
+    consumer_stats consumer_statistics(size_t index) const;
+
+private:
+    struct subscriber
+    {
+        subscriber(const consumer& config, size_t index);
+
+        consumer config;
+        size_t index; // In the ring
+        std::thread thread;
+        impl::notifier ready; // Events were published, or stop() was called
+        std::vector<event> copies; // Scratch for overwriting consumers
+        std::atomic<uint64_t> delivered;
+    };
+
+    static uint32_t consumers_mask(const std::vector<consumer>& consumers);
+
+    void on_lost(uint64_t overruns) override;
+    void on_gap(uint32_t cpu, uint64_t missed) override;
+
+    void publish(const raw_event* events, size_t count);
+    void work(subscriber& reader);
+    size_t read(subscriber& reader);
+    void deliver(subscriber& reader, const event* events, size_t count);
+
+    void fail(std::exception_ptr error);
+    void join();
+    void rethrow_error();
+
+private:
+    uint32_t _mask;
+
+    broadcast_ring<event> _ring;
+    std::vector<std::unique_ptr<subscriber>> _subscribers;
+    std::vector<event> _decoded;
+
+    // Events were read by a blocking consumer, or stop() was called
+    impl::notifier _space;
+    std::atomic<uint64_t> _blocked;
+
+    std::mutex _error_lock;
+    std::exception_ptr _error;
+};
+
+} // namespace rci
+
+#endif // RCI_BROADCAST_PROCONN_HPP
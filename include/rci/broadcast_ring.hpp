@@ -0,0 +1,288 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_BROADCAST_RING_HPP
+#define RCI_BROADCAST_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace rci {
+
+// What happens when a consumer falls a whole ring behind the producer
+enum class broadcast_policy
+{
+    block,     // The producer waits for the consumer
+    overwrite, // The consumer loses the oldest items it didn't read yet
+};
+
+// A bounded, single-producer multiple-consumer ring, where every consumer
+// reads every item through a cursor of its own, in the style of the LMAX
+// Disruptor. Items are written once, and never copied per consumer.
+//
+// The producer is only ever held back by the blocking consumers. Consumers
+// using the overwrite policy are lapped instead, and lose their own oldest
+// items, which they detect and count. Since their items may be overwritten
+// while being read, they copy them out and validate the copy afterwards.
+// Slots are made of atomic words, so these racing copies are well defined.
+// Blocking consumers read the items in place.
+//
+// Consumers are added before the ring is used, and never removed.
+template <typename T>
+class broadcast_ring
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "broadcast_ring items must be trivially copyable");
+    static_assert(sizeof(T) % sizeof(uint64_t) == 0 &&
+                      alignof(T) <= alignof(uint64_t),
+                  "broadcast_ring items must be made of 64-bit words");
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+                  "broadcast_ring slots must be read in place");
+
+public:
+    // The capacity is rounded up to a power of two
+    explicit broadcast_ring(size_t capacity)
+        : _capacity(round_up(capacity)), _mask(_capacity - 1),
+          _words(_capacity * WORDS), _producer()
+    {}
+
+    broadcast_ring(const broadcast_ring&) = delete;
+    broadcast_ring& operator=(const broadcast_ring&) = delete;
+
+    // Returns the index of the new consumer
+    size_t add_consumer(broadcast_policy policy)
+    {
+        _consumers.emplace_back(new consumer(policy));
+        return _consumers.size() - 1;
+    }
+
+    size_t consumers() const { return _consumers.size(); }
+    size_t capacity() const { return _capacity; }
+
+    // Number of items pushed so far
+    uint64_t published() const
+    {
+        return _producer.tail.load(std::memory_order_acquire);
+    }
+
+    // Items the consumer didn't read yet, more than the capacity if lapped
+    uint64_t lag(size_t index) const
+    {
+        return published() -
+               _consumers[index]->cursor.load(std::memory_order_acquire);
+    }
+
+    // Items the consumer lost to being lapped
+    uint64_t lost(size_t index) const
+    {
+        return _consumers[index]->lost.load(std::memory_order_relaxed);
+    }
+
+    // Producer: Push up to count items, publishing them all at once.
+    // Returns the number of items pushed, less than count if a blocking
+    // consumer is a whole ring behind.
+    size_t push(const T* items, size_t count)
+    {
+        uint64_t tail = _producer.tail.load(std::memory_order_relaxed);
+
+        if (_producer.limit - tail < count)
+        {
+            _producer.limit = gating_sequence() + capacity();
+        }
+
+        count = std::min<uint64_t>(count, _producer.limit - tail);
+
+        // Overwriting readers check the claim to discard torn copies
+        _producer.claim.store(tail + count, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            store((tail + i) & _mask, items[i]);
+        }
+
+        _producer.tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // Blocking consumer: Point first at the oldest unread items, in place.
+    // Returns the number of items that are contiguous in memory.
+    size_t peek(size_t index, const T*& first)
+    {
+        auto& reader  = *_consumers[index];
+        uint64_t head = reader.cursor.load(std::memory_order_relaxed);
+        uint64_t tail = published();
+        if (head == tail)
+        {
+            return 0;
+        }
+
+        // Ordered after the writes by the tail, so no word can change
+        size_t slot = head & _mask;
+        first       = reinterpret_cast<const T*>(&_words[slot * WORDS]);
+        return std::min<uint64_t>(tail - head, capacity() - slot);
+    }
+
+    // Blocking consumer: Mark count items, returned by peek(), as read
+    void consume(size_t index, size_t count)
+    {
+        auto& reader = *_consumers[index];
+        reader.cursor.store(reader.cursor.load(std::memory_order_relaxed) +
+                                count,
+                            std::memory_order_release);
+    }
+
+    // Overwriting consumer: Copy up to max oldest unread items into out.
+    // Returns the number of items copied. Items lost to being lapped are
+    // skipped and counted.
+    size_t read(size_t index, T* out, size_t max)
+    {
+        auto& reader  = *_consumers[index];
+        uint64_t head = reader.cursor.load(std::memory_order_relaxed);
+        uint64_t tail = published();
+
+        uint64_t lost = 0;
+        if (tail - head > capacity())
+        {
+            lost = tail - capacity() - head;
+            head += lost;
+        }
+
+        size_t count = std::min<uint64_t>(max, tail - head);
+        for (size_t i = 0; i < count; ++i)
+        {
+            load((head + i) & _mask, out[i]);
+        }
+
+        // Items the producer started overwriting during the copy are torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claim = _producer.claim.load(std::memory_order_relaxed);
+        uint64_t valid = claim > capacity() ? claim - capacity() : 0;
+
+        size_t torn = 0;
+        if (head < valid)
+        {
+            torn = std::min<uint64_t>(valid - head, count);
+            std::copy(out + torn, out + count, out);
+        }
+
+        reader.cursor.store(head + count, std::memory_order_release);
+        if (lost + torn)
+        {
+            reader.lost.fetch_add(lost + torn, std::memory_order_relaxed);
+        }
+
+        return count - torn;
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+    static const size_t WORDS      = sizeof(T) / sizeof(uint64_t);
+
+    struct consumer
+    {
+        explicit consumer(broadcast_policy policy)
+            : policy(policy), cursor(0), lost(0)
+        {}
+
+        const broadcast_policy policy;
+
+        // Written by the consumer, on a cache line of its own
+        char pad_front[CACHE_LINE];
+        std::atomic<uint64_t> cursor; // Sequence of the next item to read
+        std::atomic<uint64_t> lost;
+        char pad_back[CACHE_LINE];
+    };
+
+    struct producer
+    {
+        char pad_front[CACHE_LINE];
+        std::atomic<uint64_t> tail{0};  // Sequence of the next item to push
+        std::atomic<uint64_t> claim{0}; // Sequence after the items written
+        uint64_t limit = 0;             // Cached sequence the tail can reach
+        char pad_back[CACHE_LINE];
+    };
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    // Items are copied word by word, the words racing with a reader relaxed
+    void store(size_t slot, const T& item)
+    {
+        uint64_t words[WORDS];
+        memcpy(words, &item, sizeof(item));
+
+        auto target = &_words[slot * WORDS];
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            target[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    void load(size_t slot, T& item) const
+    {
+        uint64_t words[WORDS];
+
+        auto source = &_words[slot * WORDS];
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            words[i] = source[i].load(std::memory_order_relaxed);
+        }
+
+        memcpy(&item, words, sizeof(item));
+    }
+
+    // Sequence of the oldest item a blocking consumer didn't read yet
+    uint64_t gating_sequence() const
+    {
+        uint64_t gate = std::numeric_limits<uint64_t>::max() - capacity();
+        for (const auto& reader : _consumers)
+        {
+            if (reader->policy == broadcast_policy::block)
+            {
+                gate = std::min(gate, reader->cursor.load(
+                                          std::memory_order_acquire));
+            }
+        }
+        return gate;
+    }
+
+    const size_t _capacity;
+    const size_t _mask;
+    std::vector<std::atomic<uint64_t>> _words; // WORDS words per slot
+
+    producer _producer;
+    std::vector<std::unique_ptr<consumer>> _consumers;
+};
+
+} // namespace rci
+
+#endif // RCI_BROADCAST_RING_HPP
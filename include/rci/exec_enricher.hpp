@@ -0,0 +1,142 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_EXEC_ENRICHER_HPP
+#define RCI_EXEC_ENRICHER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "rci/proconn.hpp"
+
+namespace rci {
+
+// Reads what an exec event doesn't carry: The executable, arguments and
+// working directory of the process, as soon as the event is dispatched, so
+// that even short-lived processes are still around to be read.
+//
+// Every read uses buffers allocated up front, and the files are opened
+// relative to a single /proc directory fd. The process is pinned with
+// pidfd_open(2) before the reads, and checked to be alive after them, so
+// that a pid reused meanwhile is never attributed the reads.
+//
+// Attach it to a proconn, where the exec callbacks are called right on the
+// receiving thread. Not thread-safe.
+class exec_enricher
+{
+public:
+    typedef impl::proconn_base::metadata metadata;
+    typedef impl::proconn_base::task_ids task_ids;
+
+    // Some of a buffer, only valid during the callback
+    struct text
+    {
+        const char* data;
+        size_t size;
+
+        std::string str() const { return std::string(data, size); }
+    };
+
+    struct exec_info
+    {
+        metadata meta;
+        task_ids process;
+
+        // The process exited before it could be read, all texts are empty
+        bool gone;
+
+        text exe;     // Path of the executable
+        text cmdline; // Arguments, each followed by a null character
+        text cwd;     // Working directory
+
+        // Any of the texts was cut at the size of its buffer
+        bool truncated;
+
+        // Split cmdline into arguments
+        std::vector<std::string> args() const;
+    };
+
+    struct options
+    {
+        // Sizes of the buffers, the longest text that is read of each kind
+        size_t exe_max     = 4096;
+        size_t cmdline_max = 4096;
+        size_t cwd_max     = 4096;
+
+        std::string proc_root = "/proc";
+    };
+
+    struct stats
+    {
+        uint64_t execs;     // Exec events enriched
+        uint64_t gone;      // Processes that exited before they were read
+        uint64_t truncated; // Texts cut at the size of their buffer
+        uint64_t denied;    // Texts the process wasn't allowed to read
+        uint64_t unpinned;  // Reads without a pidfd, unsupported or failed
+    };
+
+    typedef std::function<void(const exec_info& info)> callback;
+
+public:
+    explicit exec_enricher(callback enriched);
+    exec_enricher(callback enriched, const options& opts);
+    ~exec_enricher();
+
+    exec_enricher(const exec_enricher&) = delete;
+    exec_enricher& operator=(const exec_enricher&) = delete;
+
+    // Chain enrich() to the exec callback
+    void attach(proconn::event_callbacks& callbacks);
+
+    // Read the process, and call the callback with what was read
+    void enrich(const metadata& meta, const task_ids& process);
+
+    // Safe to call from any thread
+    stats statistics() const;
+
+private:
+    // Returns false if the process is gone
+    bool read_link(const char* name, std::vector<char>& buffer, text& out);
+    bool read_file(const char* name, std::vector<char>& buffer, text& out);
+    bool record(int error);
+
+private:
+    callback _enriched;
+    int _proc_fd;
+    bool _pidfd_supported;
+
+    char _path[32]; // <pid>/<name>, relative to /proc
+    size_t _path_prefix;
+    bool _truncated;
+
+    std::vector<char> _exe;
+    std::vector<char> _cmdline;
+    std::vector<char> _cwd;
+
+    std::atomic<uint64_t> _execs;
+    std::atomic<uint64_t> _gone;
+    std::atomic<uint64_t> _truncated_texts;
+    std::atomic<uint64_t> _denied;
+    std::atomic<uint64_t> _unpinned;
+};
+
+} // namespace rci
+
+#endif // RCI_EXEC_ENRICHER_HPP
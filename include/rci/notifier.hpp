@@ -0,0 +1,57 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_NOTIFIER_HPP
+#define RCI_NOTIFIER_HPP
+
+#include <atomic>
+
+namespace rci {
+namespace impl {
+
+// A pollable, level-triggered wakeup between threads, backed by an eventfd.
+// Only the first notify() after a clear() makes a system call.
+//
+// The waiting side must clear(), then check its condition, and only then
+// wait(), so that a notify() racing with the check is never missed.
+class notifier
+{
+public:
+    notifier();
+    ~notifier();
+
+    notifier(const notifier&) = delete;
+    notifier& operator=(const notifier&) = delete;
+
+    // Readable while notified
+    int fd() const;
+
+    void notify();
+    void clear();
+
+    // Wait up to timeout_ms (-1 waits forever) for a notification.
+    // Returns false on timeout.
+    bool wait(int timeout_ms = -1);
+
+private:
+    int _fd;
+    std::atomic<bool> _notified;
+};
+
+} // namespace impl
+} // namespace rci
+
+#endif // RCI_NOTIFIER_HPP
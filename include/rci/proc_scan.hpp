@@ -0,0 +1,58 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_PROC_SCAN_HPP
+#define RCI_PROC_SCAN_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+namespace rci {
+namespace impl {
+
+// A process found in /proc
+struct proc_entry
+{
+    pid_t pid;
+    pid_t parent;
+    uint64_t start_ns; // CLOCK_BOOTTIME, as /proc counts it
+    char comm[16];     // Not necessarily null-terminated
+};
+
+// The current CLOCK_MONOTONIC time
+uint64_t monotonic_ns();
+
+// The time spent suspended since boot, which CLOCK_BOOTTIME counts and
+// CLOCK_MONOTONIC does not, to the precision of the start times in /proc
+uint64_t suspended_ns();
+
+// Precision of the start times in /proc
+uint64_t proc_tick_ns();
+
+// Append the processes in proc_root to out, scanning on up to threads
+// threads (0 for one per CPU). Each thread reuses a single buffer, and opens
+// the files relative to the proc_root directory.
+void scan_proc(const std::string& proc_root, size_t threads,
+               std::vector<proc_entry>& out);
+
+} // namespace impl
+} // namespace rci
+
+#endif // RCI_PROC_SCAN_HPP
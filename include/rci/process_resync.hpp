@@ -0,0 +1,165 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_PROCESS_RESYNC_HPP
+#define RCI_PROCESS_RESYNC_HPP
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "rci/proc_scan.hpp"
+#include "rci/proconn.hpp"
+#include "rci/process_table.hpp"
+
+namespace rci {
+
+// Repairs a process table after events were lost, by diffing it against
+// /proc. Processes are compared by pid and start time, so reused pids are
+// caught. Whatever changed is repaired with synthetic exit and fork events,
+// which are applied to the table and passed on to the repaired callback.
+// Synthetic forks are stamped with the start time less the time suspended
+// since boot, the earliest the fork may have happened. Processes whose parent
+// changed are moved under their new parent.
+//
+// The /proc scan runs on a background thread, while the events keep being
+// applied. Its diff is applied on the listener thread, by poll(), once the
+// events queued during the scan were applied too: After the first event
+// stamped after the scan ended, or after options::settle_ns without any.
+// Processes forked or exited during the scan are left as their events made
+// them.
+class process_resync
+{
+public:
+    typedef process_table::event event;
+    typedef impl::proconn_base::metadata metadata;
+    typedef impl::proconn_base::task_ids task_ids;
+
+    struct options
+    {
+        // Least time between the starts of two scans. Losses during that
+        // time are coalesced into a single scan once it passed.
+        uint64_t min_interval_ns = 1000000000;
+
+        // How long a diff waits for an event stamped after its scan, before
+        // assuming no events are queued anymore
+        uint64_t settle_ns = 100000000;
+
+        std::string proc_root = "/proc";
+
+        // Threads scanning /proc, 0 for one per CPU
+        size_t threads = 1;
+
+        // Called for every synthetic event, after applying it to the table
+        std::function<void(const event& evt)> repaired;
+    };
+
+    struct stats
+    {
+        uint64_t scans;      // Scans completed
+        uint64_t exits;      // Processes that exited unnoticed
+        uint64_t forks;      // Processes that were created unnoticed
+        uint64_t reparented; // Processes whose parent changed unnoticed
+    };
+
+public:
+    explicit process_resync(process_table& table);
+    process_resync(process_table& table, const options& opts);
+    ~process_resync();
+
+    process_resync(const process_resync&) = delete;
+    process_resync& operator=(const process_resync&) = delete;
+
+    // Chain into the callbacks: Lost events and gaps request a resync, and
+    // the fork, exec, comm and exit events poll, once the table was updated.
+    // Attach the table first.
+    void attach(proconn::event_callbacks& callbacks);
+
+    // Request a resync. Safe to call from any thread, but only started by
+    // poll().
+    void trigger();
+
+    // Apply the diff of a completed scan, and start a requested scan once
+    // the rate limit allows. Call on the thread updating the table.
+    // Returns true if a diff was applied. Rethrows errors of the scan.
+    bool poll();
+
+    // Readable whenever poll() has work to do without an event to poll it:
+    // A scan completed, or waited long enough to be applied or started
+    int ready_fd() const;
+
+    // Whether a scan is running, or waits to be applied
+    bool running() const;
+
+    // Safe to call from any thread
+    stats statistics() const;
+
+private:
+    void touch(const metadata& meta, const task_ids& process);
+    void applied(const metadata& meta);
+    void start(uint64_t now_ns);
+    void arm(uint64_t deadline_ns);
+    void scan();
+    void reconcile();
+    void repair_exit(const process_table::node& process);
+    void repair_fork(const impl::proc_entry& process);
+    uint64_t monotonic_start(uint64_t start_ns) const;
+    bool same_start(uint64_t lhs_ns, uint64_t rhs_ns) const;
+
+private:
+    process_table& _table;
+    options _options;
+    uint64_t _tick_ns;
+
+    std::atomic<bool> _requested;
+    bool _running;
+    bool _settling; // The scan completed, its diff waits for the events
+    uint64_t _started_ns;
+    uint64_t _started_boot_ns; // In CLOCK_BOOTTIME, like the start times
+    uint64_t _last_start_ns;
+    uint64_t _newest_ns; // Newest event applied to the table
+
+    // Processes forked or exited during the scan, not to be repaired
+    std::unordered_set<pid_t> _touched;
+
+    // Expires at the deadline of poll(), or once the scan completed
+    int _timer;
+    uint64_t _deadline_ns;
+
+    // Written by the scanning thread until it sets _finished
+    std::thread _worker;
+    std::vector<impl::proc_entry> _snapshot;
+    uint64_t _scanned_ns;
+    std::exception_ptr _error;
+    std::atomic<bool> _finished;
+
+    std::atomic<uint64_t> _scans;
+    std::atomic<uint64_t> _exits;
+    std::atomic<uint64_t> _forks;
+    std::atomic<uint64_t> _reparented;
+};
+
+} // namespace rci
+
+#endif // RCI_PROCESS_RESYNC_HPP
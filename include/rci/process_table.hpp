@@ -0,0 +1,222 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_PROCESS_TABLE_HPP
+#define RCI_PROCESS_TABLE_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "rci/proconn.hpp"
+
+namespace rci {
+
+// Identifies a process across pid reuse: Its tgid, and its start time. Start
+// times are in CLOCK_BOOTTIME, like in /proc, which goes on while the system
+// is suspended. Fork timestamps, in CLOCK_MONOTONIC, are moved to it by the
+// time suspended as of when they are applied, so a suspend between a fork and
+// its event shifts that start time. A start time of 0 means an unknown process.
+struct process_key
+{
+    pid_t pid;
+    uint64_t start_ns;
+
+    bool known() const { return start_ns != 0; }
+};
+
+inline bool operator==(const process_key& lhs, const process_key& rhs)
+{
+    return lhs.pid == rhs.pid && lhs.start_ns == rhs.start_ns;
+}
+
+inline bool operator!=(const process_key& lhs, const process_key& rhs)
+{
+    return !(lhs == rhs);
+}
+
+inline bool operator<(const process_key& lhs, const process_key& rhs)
+{
+    return lhs.pid != rhs.pid ? lhs.pid < rhs.pid
+                              : lhs.start_ns < rhs.start_ns;
+}
+
+// A live table of the processes on the system, kept up to date from fork,
+// exec, comm and exit events. Thread level events are ignored.
+//
+// Processes are kept in an open-addressing table with linear probing, a
+// compact node per process (tgid). The children of a process are linked
+// through their nodes, so neither events nor queries allocate, except for
+// the table growing, which is amortized and avoidable by sizing it up
+// front. Not thread-safe.
+class process_table
+{
+public:
+    typedef impl::proconn_base::event event;
+
+    static const pid_t MISSING_PID = impl::proconn_base::MISSING_PID;
+
+    struct node
+    {
+        pid_t pid;
+        pid_t parent;       // MISSING_PID if orphaned since it was added
+        pid_t first_child;  // Newest child, MISSING_PID if none
+        pid_t next_sibling; // Next older child of the same parent
+        pid_t prev_sibling; // Next newer child of the same parent
+        uint32_t exec_count;
+        uint64_t start_ns; // CLOCK_BOOTTIME, see process_key
+        char comm[16];     // Not necessarily null-terminated
+    };
+
+public:
+    // The capacity is rounded up to a power of two, and doubles whenever
+    // the table gets half full
+    explicit process_table(size_t capacity = 4096);
+
+    // Update the table from an event
+    void apply(const event& evt);
+
+    // Add the processes that already exist, scanning /proc on up to
+    // threads threads (0 for one per CPU). Processes already in the table
+    // are kept as they are. Returns the number of processes added.
+    //
+    // To miss no process, start() the listener before bootstrapping, and
+    // apply the events it queued during the scan afterwards. Forks that
+    // happened during the scan, of processes the scan found too, are then
+    // recognized by their start time and not added twice. Exits during the
+    // scan remove the processes it found.
+    size_t bootstrap(const std::string& proc_root = "/proc",
+                     size_t threads = 0);
+
+    // Called with every event, and the key of the process it is about,
+    // for forks that of the child
+    typedef std::function<void(const event& evt, const process_key& key)>
+        keyed_callback;
+
+    // Chain apply() to the fork, exec, comm and exit callbacks, after the
+    // callbacks already set, so exit callbacks can still find the exiting
+    // process. Other event types are left out of the kernel filters.
+    void attach(proconn::event_callbacks& callbacks);
+
+    // Same, also calling keyed with these events, from the table, with no
+    // reads from /proc. Called after forks are applied, and before all
+    // other events, so exits still have the key of the exiting process.
+    void attach(proconn::event_callbacks& callbacks, keyed_callback keyed);
+
+    // Add a process, replacing any process with the same pid, and link it
+    // to its parent, if the parent is known
+    node& insert(pid_t pid, pid_t parent, uint64_t start_ns);
+
+    // Remove a process, orphaning its children. Returns false if unknown.
+    bool erase(pid_t pid);
+
+    // Move a process under another parent. Returns false if unknown.
+    bool reparent(pid_t pid, pid_t parent);
+
+    void clear();
+
+    // nullptr if unknown. Valid until the table is modified.
+    const node* find(pid_t pid) const;
+
+    // MISSING_PID if unknown
+    pid_t parent(pid_t pid) const;
+
+    // The key of a known process, one with a start time of 0 otherwise
+    process_key key(pid_t pid) const;
+
+    // Call func(const node&) for every known child
+    template <typename Func>
+    void for_each_child(pid_t pid, Func&& func) const
+    {
+        const node* current = find(pid);
+        pid_t child = current ? current->first_child : MISSING_PID;
+        while (child != MISSING_PID)
+        {
+            current = find(child);
+            func(*current);
+            child = current->next_sibling;
+        }
+    }
+
+    // Call func(const node&) for every process, in no particular order.
+    // The table must not be modified meanwhile.
+    template <typename Func>
+    void for_each(Func&& func) const
+    {
+        for (const auto& entry : _slots)
+        {
+            if (entry.pid != MISSING_PID)
+            {
+                func(entry);
+            }
+        }
+    }
+
+    // Append the pids of all known children to out. Returns their number.
+    size_t children(pid_t pid, std::vector<pid_t>& out) const;
+
+    size_t size() const;
+    size_t capacity() const;
+
+private:
+    size_t home(pid_t pid) const;
+    size_t slot(pid_t pid) const; // Of the process, or the empty slot for it
+    node* lookup(pid_t pid);
+
+    void link(node& child);
+    void unlink(const node& child);
+    void remove(size_t index);
+    void grow();
+
+    void relink();
+
+    void on_fork(const event& evt);
+    void on_exec(const event& evt);
+    void on_comm(const event& evt);
+    void on_exit(const event& evt);
+
+private:
+    std::vector<node> _slots; // Empty slots have a pid of MISSING_PID
+    size_t _mask;
+    unsigned _shift;
+    size_t _size;
+
+    // Forks up to this time may be of processes found by bootstrap()
+    uint64_t _scanned_until_ns;
+    uint64_t _tick_ns; // Precision of the start times in /proc
+};
+
+} // namespace rci
+
+namespace std {
+
+template <>
+struct hash<rci::process_key>
+{
+    size_t operator()(const rci::process_key& key) const
+    {
+        return hash<uint64_t>()(key.start_ns ^
+                                (static_cast<uint64_t>(key.pid) << 32));
+    }
+};
+
+} // namespace std
+
+#endif // RCI_PROCESS_TABLE_HPP
@@ -4,88 +4,20 @@
 #include <cstdint>
 
 #include <functional>
+#include <memory>
 #include <vector>
 
-#include <linux/cn_proc.h>
-#include <linux/connector.h>
-#include <linux/netlink.h>
-
-#include "rci/proconn_error.hpp"
+#include "rci/proconn_base.hpp"
+#include "rci/reorder_window.hpp"
+#include "rci/thread_coalescer.hpp"
 
 namespace rci {
 
-class proconn final
+class proconn final : public impl::proconn_base
 {
 public:
-    static const pid_t MISSING_PID = 0;
-
-    struct metadata {
-        uint32_t cpu;
-        uint64_t timestamp_ns;
-    };
-
-    struct task_ids {
-        pid_t tid;
-        pid_t pid;
-    };
-
-    struct fork_event {
-        metadata meta;
-        task_ids parent;
-        task_ids child;
-    };
-
-    struct exec_event {
-        metadata meta;
-        task_ids process;
-    };
-
-    struct uid_event {
-        metadata meta;
-        task_ids process;
-        uid_t ruid;
-        uid_t euid;
-    };
-
-    struct gid_event {
-        metadata meta;
-        task_ids process;
-        uid_t rgid;
-        uid_t egid;
-    };
-
-    struct sid_event {
-        metadata meta;
-        task_ids process;
-    };
-
-    struct ptrace_event {
-        metadata meta;
-        task_ids process;
-        task_ids tracer;
-    };
-
-    struct comm_event {
-        metadata meta;
-        task_ids process;
-        std::string comm;
-    };
+    typedef thread_coalescer::churn thread_churn;
 
-    struct coredump_event {
-        metadata meta;
-        task_ids process;
-        task_ids parent;  // Supported from kernel 4.18.0
-    } coredump;
-
-    struct exit_event {
-        metadata meta;
-        task_ids process;
-        uint32_t exit_code;
-        uint32_t exit_signal;
-        task_ids parent;  // Supported from kernel 4.18.0
-    };
-
-public:
     struct event_callbacks
     {
         std::function<void(fork_event)>           fork;
@@ -97,10 +29,52 @@ public:
         std::function<void(comm_event event)>     comm;     // From kernel 3.1.0
         std::function<void(coredump_event event)> coredump; // From kernel 3.10.0
         std::function<void(exit_event event)>     exit;
+
+        // Called with the total number of overruns seen so far, every time
+        // the socket receive queue overflows and events are lost.
+        // Only used with overrun_policy::report.
+        std::function<void(uint64_t overruns)>    lost;
+
+        // Called when the sequence numbers reported by a CPU skip, with the
+        // exact number of events from that CPU that were never received
+        std::function<void(uint32_t cpu, uint64_t missed)> gap;
+
+        // Called for every event, of any type, along with the per-type
+        // callbacks, for consumers that handle all events the same way
+        std::function<void(const event& event)> any;
+
+        // Called once per receive, with all of its events decoded into a
+        // contiguous array that is reused, and only valid during the call.
+        // Receives every event type, along with any per-type callbacks.
+        std::function<void(const event* first, size_t count)> batch;
+
+        // Called every options::thread_report_ns, while coalescing threads,
+        // for every process that spawned or lost threads since the last call
+        std::function<void(const thread_churn& churn)> threads;
+    };
+
+    // Callbacks receiving views instead of event structs, so that no event
+    // is ever copied or allocated. Both callbacks are called when set for
+    // the same event type.
+    struct view_callbacks
+    {
+        std::function<void(const fork_event_view&)>     fork;
+        std::function<void(const exec_event_view&)>     exec;
+        std::function<void(const uid_event_view&)>      uid;
+        std::function<void(const gid_event_view&)>      gid;
+        std::function<void(const sid_event_view&)>      sid;
+        std::function<void(const ptrace_event_view&)>   ptrace;
+        std::function<void(const comm_event_view&)>     comm;
+        std::function<void(const coredump_event_view&)> coredump;
+        std::function<void(const exit_event_view&)>     exit;
     };
 
 public:
-    explicit proconn(event_callbacks callbacks, size_t recv_buffer = 2048);
+    explicit proconn(event_callbacks callbacks, size_t recv_buffer = 2048,
+                     size_t recv_batch = 1);
+    proconn(event_callbacks callbacks, const options& opts);
+    proconn(event_callbacks callbacks, view_callbacks views,
+            const options& opts);
     ~proconn();
 
     proconn(const proconn&) = delete;
@@ -109,32 +83,62 @@ public:
     proconn& operator=(const proconn&) = delete;
     proconn& operator=(proconn&&) = delete;
 
-    void run();
-    void stop();
+    // The event types the callbacks receive, as a mask of proc_event::what
+    // values, for the kernel filters
+    static uint32_t event_mask(const event_callbacks& callbacks);
 
-private:
-    static sockaddr_nl build_proconn_addr(pid_t tid);
-    static sockaddr_nl build_bind_addr();
-    static sockaddr_nl build_kernel_addr();
+    // Call the per-type callbacks and the generic callback of an event
+    // decoded earlier, e.g. one taken out of a queue
+    static void deliver(const event_callbacks& callbacks, const event& evt);
 
-    int socket_create();
-    void socket_register();
-    void socket_unregister();
+    // Blocks, dispatching events, until stop() is called
+    void run();
 
-    int socket_send_op(enum proc_cn_mcast_op op);
-    int socket_recv(sockaddr_nl& nl_addr, std::vector<uint8_t>& nl_buffer);
+    // Dispatch up to max_events pending events without blocking.
+    // Returns the number of events dispatched, 0 if none were pending.
+    // When reordering or coalescing threads, also releases the held events
+    // that are due, so it should be called at least once per window.
+    size_t process_pending(size_t max_events = 1024);
 
-    void dispatch_event(const uint8_t* data, uint16_t len);
+    // Statistics of the reordering window, all zero when not reordering.
+    // Safe to call from any thread.
+    reorder_window::stats reordering() const;
+
+    // Statistics of thread coalescing, all zero when not coalescing.
+    // Safe to call from any thread.
+    thread_coalescer::stats coalescing() const;
 
 private:
-    event_callbacks _callbacks;
+    void on_lost(uint64_t overruns) override;
+    void on_gap(uint32_t cpu, uint64_t missed) override;
 
-    size_t _recv_buffer;
+    void dispatch(const raw_event* events, size_t count);
+    void dispatch_event(const raw_event& event);
+    void dispatch_decoded(const event* events, size_t count);
 
-    sockaddr_nl _bind_addr;
-    sockaddr_nl _kernel_addr;
+    void stage(const raw_event* events, size_t count);
+    void stage_flush();
+    void coalesce(const event& evt);
+    void report_threads(uint64_t now_ns, bool force);
+    void update_timer();
 
-    int _socket;
+private:
+    event_callbacks _callbacks;
+    view_callbacks _views;
+    std::vector<event> _decoded;
+
+    // Stages that hold events before they are delivered, and a timer
+    // releasing the held events while idle
+    uint32_t _mask;
+    std::unique_ptr<reorder_window> _reorder;
+    std::unique_ptr<thread_coalescer> _coalescer;
+    std::vector<event> _reordered;
+    std::vector<thread_churn> _churn;
+    uint64_t _newest_ns;
+    uint64_t _report_ns;
+    uint64_t _next_report_ns;
+    int _timer;
+    uint64_t _timer_interval_ns;
 };
 
 } // namespace rci
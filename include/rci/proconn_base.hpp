@@ -0,0 +1,702 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_PROCONN_BASE_HPP
+#define RCI_PROCONN_BASE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+
+#include "rci/proconn_error.hpp"
+#include "rci/proconn_event.hpp"
+
+namespace rci {
+namespace impl {
+
+// Everything about talking to the proc connector, except for dispatching
+// the events: Registration, batched receives, loss accounting and filters.
+// The events of every receive are handed over as one batch, so that the
+// derived listeners can decide how to dispatch them.
+class proconn_base
+{
+public:
+    static const pid_t MISSING_PID = 0;
+
+    // Every event type, as a mask of proc_event::what values
+    static constexpr uint32_t ALL_EVENTS =
+        proconn_event::PROC_EVENT_FORK | proconn_event::PROC_EVENT_EXEC |
+        proconn_event::PROC_EVENT_UID | proconn_event::PROC_EVENT_GID |
+        proconn_event::PROC_EVENT_SID | proconn_event::PROC_EVENT_PTRACE |
+        proconn_event::PROC_EVENT_COMM | proconn_event::PROC_EVENT_COREDUMP |
+        proconn_event::PROC_EVENT_EXIT;
+
+    struct metadata {
+        uint32_t cpu;
+        uint64_t timestamp_ns;
+    };
+
+    struct task_ids {
+        pid_t tid;
+        pid_t pid;
+    };
+
+    struct fork_event {
+        metadata meta;
+        task_ids parent;
+        task_ids child;
+    };
+
+    struct exec_event {
+        metadata meta;
+        task_ids process;
+    };
+
+    struct uid_event {
+        metadata meta;
+        task_ids process;
+        uid_t ruid;
+        uid_t euid;
+    };
+
+    struct gid_event {
+        metadata meta;
+        task_ids process;
+        uid_t rgid;
+        uid_t egid;
+    };
+
+    struct sid_event {
+        metadata meta;
+        task_ids process;
+    };
+
+    struct ptrace_event {
+        metadata meta;
+        task_ids process;
+        task_ids tracer;
+    };
+
+    struct comm_event {
+        metadata meta;
+        task_ids process;
+        std::string comm;
+    };
+
+    struct coredump_event {
+        metadata meta;
+        task_ids process;
+        task_ids parent;  // Supported from kernel 4.18.0
+    } coredump;
+
+    struct exit_event {
+        metadata meta;
+        task_ids process;
+        uint32_t exit_code;
+        uint32_t exit_signal;
+        task_ids parent;  // Supported from kernel 4.18.0
+    };
+
+    enum class event_type : uint32_t
+    {
+        none     = proconn_event::PROC_EVENT_NONE,
+        fork     = proconn_event::PROC_EVENT_FORK,
+        exec     = proconn_event::PROC_EVENT_EXEC,
+        uid      = proconn_event::PROC_EVENT_UID,
+        gid      = proconn_event::PROC_EVENT_GID,
+        sid      = proconn_event::PROC_EVENT_SID,
+        ptrace   = proconn_event::PROC_EVENT_PTRACE,
+        comm     = proconn_event::PROC_EVENT_COMM,
+        coredump = proconn_event::PROC_EVENT_COREDUMP,
+        exit     = proconn_event::PROC_EVENT_EXIT,
+    };
+
+    // Any event, tagged by its type. Only the payload matching the type is
+    // set. Unlike the event structs above, it never allocates, so batches
+    // of it can be decoded into a reusable array. It is trivially copyable,
+    // with a fixed size and layout, and decoded events have their unused
+    // bytes zeroed, so it can be copied as is into ring buffers and files.
+    struct event
+    {
+        struct fork_data {
+            task_ids parent;
+            task_ids child;
+        };
+
+        struct exec_data {
+            task_ids process;
+        };
+
+        struct uid_data {
+            task_ids process;
+            uid_t ruid;
+            uid_t euid;
+        };
+
+        struct gid_data {
+            task_ids process;
+            gid_t rgid;
+            gid_t egid;
+        };
+
+        struct sid_data {
+            task_ids process;
+        };
+
+        struct ptrace_data {
+            task_ids process;
+            task_ids tracer;
+        };
+
+        struct comm_data {
+            task_ids process;
+            char comm[16]; // Not necessarily null-terminated
+        };
+
+        struct coredump_data {
+            task_ids process;
+            task_ids parent; // Supported from kernel 4.18.0
+        };
+
+        struct exit_data {
+            task_ids process;
+            uint32_t exit_code;
+            uint32_t exit_signal;
+            task_ids parent; // Supported from kernel 4.18.0
+        };
+
+        event_type type;
+        metadata meta;
+        union {
+            fork_data fork;
+            exec_data exec;
+            uid_data uid;
+            gid_data gid;
+            sid_data sid;
+            ptrace_data ptrace;
+            comm_data comm;
+            coredump_data coredump;
+            exit_data exit;
+        };
+    };
+
+    static_assert(std::is_trivially_copyable<event>::value,
+                  "event must be copyable with memcpy");
+    static_assert(std::is_standard_layout<event>::value,
+                  "event must have a fixed layout");
+    static_assert(sizeof(event) == 48, "event size changed");
+
+public:
+    // Zero-copy alternatives to the event structs above.
+    // Views read straight from the receive buffer, and are only valid for the
+    // duration of the callback they are passed to.
+
+    // The 16 bytes comm of a task, not necessarily null-terminated
+    class comm_view
+    {
+    public:
+        static const size_t CAPACITY = 16;
+
+        explicit comm_view(const char* comm) : _comm(comm) {}
+
+        const char* data() const { return _comm; }
+        size_t size() const { return strnlen(_comm, CAPACITY); }
+        std::string str() const { return std::string(_comm, size()); }
+
+    private:
+        const char* _comm;
+    };
+
+    class event_view
+    {
+    public:
+        event_view(const proconn_event* evt, uint16_t len)
+            : _evt(evt), _len(len)
+        {}
+
+        metadata meta() const { return {_evt->cpu, _evt->timestamp_ns}; }
+
+    protected:
+        task_ids ids(pid_t pid, pid_t tgid) const { return {pid, tgid}; }
+
+        // Whether the message is long enough to hold size bytes of data
+        bool has(size_t size) const
+        {
+            return _len >= proconn_event_header_size() + size;
+        }
+
+        const proconn_event* _evt;
+        uint16_t _len;
+    };
+
+    class fork_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids parent() const
+        {
+            return ids(_evt->event_data.fork.parent_pid,
+                       _evt->event_data.fork.parent_tgid);
+        }
+
+        task_ids child() const
+        {
+            return ids(_evt->event_data.fork.child_pid,
+                       _evt->event_data.fork.child_tgid);
+        }
+    };
+
+    class exec_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.exec.process_pid,
+                       _evt->event_data.exec.process_tgid);
+        }
+    };
+
+    class uid_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.id.process_pid,
+                       _evt->event_data.id.process_tgid);
+        }
+
+        uid_t ruid() const { return _evt->event_data.id.r.ruid; }
+        uid_t euid() const { return _evt->event_data.id.e.euid; }
+    };
+
+    class gid_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.id.process_pid,
+                       _evt->event_data.id.process_tgid);
+        }
+
+        gid_t rgid() const { return _evt->event_data.id.r.rgid; }
+        gid_t egid() const { return _evt->event_data.id.e.egid; }
+    };
+
+    class sid_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.sid.process_pid,
+                       _evt->event_data.sid.process_tgid);
+        }
+    };
+
+    class ptrace_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.ptrace.process_pid,
+                       _evt->event_data.ptrace.process_tgid);
+        }
+
+        task_ids tracer() const
+        {
+            return ids(_evt->event_data.ptrace.tracer_pid,
+                       _evt->event_data.ptrace.tracer_tgid);
+        }
+    };
+
+    class comm_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.comm.process_pid,
+                       _evt->event_data.comm.process_tgid);
+        }
+
+        comm_view comm() const { return comm_view(_evt->event_data.comm.comm); }
+    };
+
+    class coredump_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.coredump.process_pid,
+                       _evt->event_data.coredump.process_tgid);
+        }
+
+        task_ids parent() const // Supported from kernel 4.18.0
+        {
+            if (!has(sizeof(_evt->event_data.coredump)))
+            {
+                return ids(MISSING_PID, MISSING_PID);
+            }
+
+            return ids(_evt->event_data.coredump.parent_pid,
+                       _evt->event_data.coredump.parent_tgid);
+        }
+    };
+
+    class exit_event_view : public event_view
+    {
+    public:
+        using event_view::event_view;
+
+        task_ids process() const
+        {
+            return ids(_evt->event_data.exit.process_pid,
+                       _evt->event_data.exit.process_tgid);
+        }
+
+        uint32_t exit_code() const { return _evt->event_data.exit.exit_code; }
+        uint32_t exit_signal() const
+        {
+            return _evt->event_data.exit.exit_signal;
+        }
+
+        task_ids parent() const // Supported from kernel 4.18.0
+        {
+            if (!has(sizeof(_evt->event_data.exit)))
+            {
+                return ids(MISSING_PID, MISSING_PID);
+            }
+
+            return ids(_evt->event_data.exit.parent_pid,
+                       _evt->event_data.exit.parent_tgid);
+        }
+    };
+
+public:
+    enum class overrun_policy
+    {
+        raise,  // Throw a proconn_error out of run()
+        report, // Count, report as lost events and carry on
+    };
+
+    struct options
+    {
+        // Size of a single receive buffer (one datagram)
+        size_t recv_buffer = 2048;
+
+        // Number of datagrams pulled from the socket by a single system
+        // call. Values bigger than 1 use recvmmsg(2) and reuse a pool of
+        // recv_batch buffers, each recv_buffer bytes long.
+        size_t recv_batch = 1;
+
+        // What to do when the socket receive queue overflows
+        overrun_policy overrun = overrun_policy::raise;
+
+        // Requested size of the kernel socket receive queue, in bytes.
+        // 0 keeps the system default. SO_RCVBUFFORCE is tried first, as it
+        // requires CAP_NET_ADMIN, and SO_RCVBUF (capped by the kernel at
+        // net.core.rmem_max) is used as a fallback.
+        size_t socket_buffer = 0;
+
+        // When bigger than the current size, every overrun doubles the size
+        // of the kernel receive queue, up to this many bytes.
+        size_t socket_buffer_max = 0;
+
+        // Have the kernel drop events with no callback before they are ever
+        // queued. Kernels 6.6 and newer filter event types natively in the
+        // proc connector. Older kernels use a socket filter (SO_ATTACH_FILTER)
+        // instead. Filtered events still consume sequence numbers, so gap
+        // detection is disabled while filtering in the kernel.
+        bool kernel_filter = false;
+
+        // Event types kept by the kernel filter, as a mask of
+        // proc_event::what values. 0 derives it from the callbacks.
+        uint32_t event_mask = 0;
+
+        // Have the kernel filter drop thread level fork and exit events,
+        // keeping only those of processes (where task_ids::tid == pid)
+        bool processes_only = false;
+
+        // When not empty, have the kernel filter keep only the events of
+        // these processes (task_ids::pid). Forks belong to the parent.
+        std::vector<pid_t> pids;
+
+        // Hold the events up to this long, and release them ordered by their
+        // timestamps, across CPUs. 0 disables reordering. Only supported by
+        // proconn, and not for view callbacks.
+        uint64_t reorder_window_ns = 0;
+
+        // Most events held for reordering at once
+        size_t reorder_max_events = 4096;
+
+        // Hold the forks of threads up to this long, and drop the whole life
+        // of the threads that exit within it, counting them per process
+        // instead. 0 disables coalescing. Only supported by proconn, and not
+        // for view callbacks.
+        uint64_t thread_window_ns = 0;
+
+        // Most threads held at once
+        size_t thread_max_held = 4096;
+
+        // How often the per-process thread counters are reported
+        uint64_t thread_report_ns = 1000000000;
+    };
+
+    enum class filter_mode
+    {
+        user,   // Every event reaches user space, unwanted ones are ignored
+        native, // The proc connector filters event types (Kernel 6.6.0)
+        socket, // A socket filter drops unwanted event types
+    };
+
+    struct stats
+    {
+        uint64_t overruns;    // Receive queue overflows, each losing events
+        size_t socket_buffer; // Actual size of the kernel receive queue
+
+        uint64_t gaps;                  // Events missed, over all CPUs
+        std::vector<uint64_t> cpu_gaps; // Events missed, indexed by CPU
+    };
+
+public:
+    proconn_base(const proconn_base&) = delete;
+    proconn_base(proconn_base&&)      = delete;
+
+    proconn_base& operator=(const proconn_base&) = delete;
+    proconn_base& operator=(proconn_base&&) = delete;
+
+    // Makes run() return at once, even if it is blocked waiting for events,
+    // and unregisters from the kernel. Safe to call from any thread.
+    void stop();
+
+    // Pollable mode, for integrating with an existing event loop:
+    // Register with the kernel using start(), wait for fd() to become
+    // readable, and call process_pending() to dispatch the queued events.
+
+    // Register with the kernel. Called implicitly by run() and
+    // process_pending(), does nothing if already registered or stopped.
+    void start();
+
+    // The netlink socket, readable whenever events are pending
+    int fd() const;
+
+    // Safe to call from any thread
+    stats statistics() const;
+
+    // How unwanted event types are filtered
+    filter_mode filtering() const;
+
+    // Replace the set of processes kept by the kernel filter, e.g. to follow
+    // the children of supervised processes. An empty set removes the pid
+    // filter, and resumes tracking gaps if nothing else is filtered.
+    // Safe to call from any thread.
+    void filter_pids(const std::vector<pid_t>& pids);
+
+protected:
+    // A single event, pointing into the receive pool
+    struct raw_event
+    {
+        const proconn_event* data;
+        uint16_t len;
+    };
+
+    // callbacks_mask is the set of event types the derived listener handles,
+    // as a mask of proc_event::what values, for the kernel filters
+    proconn_base(const options& opts, uint32_t callbacks_mask);
+    ~proconn_base();
+
+    // Whether stop() was called
+    bool stopping() const { return _stopping; }
+
+    // Loss reports, called on the receiving thread
+    virtual void on_lost(uint64_t overruns);
+    virtual void on_gap(uint32_t cpu, uint64_t missed);
+
+    // Decode a raw event into out. Returns false for unknown event types.
+    static bool decode(const raw_event& raw, event& out);
+
+    // Have receive_loop() also wait for fd to become readable, and call
+    // dispatch with an empty batch whenever it does. Call before running.
+    void watch(int fd);
+
+    // Receive until stop() is called, passing every batch of events to
+    // dispatch(const raw_event* events, size_t count)
+    template <typename Dispatch>
+    void receive_loop(Dispatch&& dispatch);
+
+    // Receive without blocking, up to max_events, passing every batch of
+    // events to dispatch(const raw_event* events, size_t count).
+    // Returns the number of events received.
+    template <typename Dispatch>
+    size_t receive_pending(size_t max_events, Dispatch&& dispatch);
+
+private:
+    static sockaddr_nl build_proconn_addr(pid_t tid);
+    static sockaddr_nl build_bind_addr();
+    static sockaddr_nl build_kernel_addr();
+
+    int socket_create();
+    int wakeup_create();
+    void wakeup_signal();
+    void wakeup_clear();
+    bool wait_readable();
+
+    void socket_register();
+    void socket_unregister();
+
+    void socket_attach_filter();
+
+    void socket_set_buffer(size_t size);
+    size_t socket_get_buffer();
+    void socket_grow_buffer();
+
+    int socket_send_op(enum proc_cn_mcast_op op, uint32_t event_mask = 0);
+    bool socket_recv(size_t max_datagrams);
+
+    void recv_pool_init();
+    void handle_overrun(int meta);
+    void process_message(const sockaddr_nl& addr, const uint8_t* data,
+                         size_t len);
+
+    uint32_t listen_mask() const;
+
+    void track_sequence(uint32_t seq, const uint8_t* data, uint16_t len);
+
+    bool run_begin();
+    void run_end(bool completed);
+    bool receive(size_t max_datagrams);
+
+private:
+    options _options;
+    uint32_t _callbacks_mask;
+
+    // Events of the last batch received, pointing into the receive pool
+    std::vector<raw_event> _batch;
+
+    std::vector<uint8_t> _recv_pool;
+    std::vector<sockaddr_nl> _recv_addrs;
+    std::vector<iovec> _recv_iovs;
+    std::vector<mmsghdr> _recv_msgs;
+
+    sockaddr_nl _bind_addr;
+    sockaddr_nl _kernel_addr;
+
+    int _socket;
+    int _wakeup;
+
+    int _watched;        // Polled along with the socket, -1 if not set
+    bool _watched_ready; // Whether the last wait was woken up by it
+
+    // Guards the registration state against concurrent stop() calls
+    std::mutex _state_lock;
+    bool _registered;
+    bool _running;
+    std::atomic<bool> _stopping;
+
+    size_t _socket_buffer_req;
+
+    filter_mode _filter_mode;
+
+    std::atomic<uint64_t> _overruns;
+    std::atomic<size_t> _socket_buffer;
+
+    // The kernel numbers the events it sends from every CPU sequentially.
+    // Next expected sequence number per CPU, valid only once seen.
+    std::atomic<bool> _track_gaps;
+    std::atomic<bool> _resync_sequences; // Forget the sequences seen so far
+    std::vector<uint32_t> _cpu_next_seq;
+    std::vector<bool> _cpu_seen;
+
+    std::atomic<uint64_t> _gaps;
+    std::vector<std::atomic<uint64_t>> _cpu_gaps;
+};
+
+template <typename Dispatch>
+void proconn_base::receive_loop(Dispatch&& dispatch)
+{
+    if (!run_begin())
+    {
+        return;
+    }
+
+    try
+    {
+        while (!_stopping && wait_readable())
+        {
+            if (_watched_ready)
+            {
+                dispatch(_batch.data(), 0);
+            }
+
+            // Drain the queue, but keep an eye on stop() requests
+            while (!_stopping && receive(_options.recv_batch))
+            {
+                dispatch(_batch.data(), _batch.size());
+            }
+        }
+    }
+    catch (...)
+    {
+        run_end(false);
+        throw;
+    }
+
+    run_end(true);
+}
+
+template <typename Dispatch>
+size_t proconn_base::receive_pending(size_t max_events, Dispatch&& dispatch)
+{
+    start();
+
+    size_t events = 0;
+    while (!_stopping && events < max_events && receive(max_events - events))
+    {
+        dispatch(_batch.data(), _batch.size());
+        events += _batch.size();
+    }
+
+    return events;
+}
+
+} // namespace impl
+} // namespace rci
+
+#endif // RCI_PROCONN_BASE_HPP
@@ -0,0 +1,143 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_PROCONN_EVENT_HPP
+#define RCI_PROCONN_EVENT_HPP
+
+#include <cstddef>
+
+#include <linux/types.h>
+
+namespace rci {
+namespace impl {
+
+// Important note here:
+// ====================
+// This is the definition of 'struct proc_event' from kernel version 5.12.
+// Name is 'proconn_event' instead of 'proc_event' to prevent collisions.
+// We copy the struct here so that no matter which platform you use to
+// compile the proc connector, you can use it with all of the possible
+// kernel versions.
+// How? Instead of '#ifdef'-ing on the linux version to decide which members
+// are out there and which aren't, we compare the lenght of the incoming
+// message against the expected offsets of the members.
+// There is a caveat here. Because this is a union, the size of it is
+// always defined by the biggest possible member.
+// So, for example, on kernel 4.15, the parent information is not reported
+// for exit events, but the size is big enough to make us believe it is.
+// It's OK though becuase the kernel code always calls:
+// `memset(&ev->event_data, 0, sizeof(ev->event_data));`
+// So even if it's missing, we get 0, which we define as MISSING_PID.
+struct proconn_event {
+	enum what {
+		/* Use successive bits so the enums can be used to record
+		 * sets of events as well
+		 */
+		PROC_EVENT_NONE = 0x00000000,
+		PROC_EVENT_FORK = 0x00000001,
+		PROC_EVENT_EXEC = 0x00000002,
+		PROC_EVENT_UID  = 0x00000004,
+		PROC_EVENT_GID  = 0x00000040,
+		PROC_EVENT_SID  = 0x00000080,
+		PROC_EVENT_PTRACE = 0x00000100,
+		PROC_EVENT_COMM = 0x00000200,
+		/* "next" should be 0x00000400 */
+		/* "last" is the last process event: exit,
+		 * while "next to last" is coredumping event */
+		PROC_EVENT_COREDUMP = 0x40000000,
+		PROC_EVENT_EXIT = 0x80000000
+	} what;
+	__u32 cpu;
+	__u64 __attribute__((aligned(8))) timestamp_ns;
+		/* Number of nano seconds since system boot */
+	union { /* must be last field of proc_event struct */
+		struct {
+			__u32 err;
+		} ack;
+
+		struct fork_proc_event {
+			__kernel_pid_t parent_pid;
+			__kernel_pid_t parent_tgid;
+			__kernel_pid_t child_pid;
+			__kernel_pid_t child_tgid;
+		} fork;
+
+		struct exec_proc_event {
+			__kernel_pid_t process_pid;
+			__kernel_pid_t process_tgid;
+		} exec;
+
+		struct id_proc_event {
+			__kernel_pid_t process_pid;
+			__kernel_pid_t process_tgid;
+			union {
+				__u32 ruid; /* task uid */
+				__u32 rgid; /* task gid */
+			} r;
+			union {
+				__u32 euid;
+				__u32 egid;
+			} e;
+		} id;
+
+		struct sid_proc_event {
+			__kernel_pid_t process_pid;
+			__kernel_pid_t process_tgid;
+		} sid;
+
+		struct ptrace_proc_event {
+			__kernel_pid_t process_pid;
+			__kernel_pid_t process_tgid;
+			__kernel_pid_t tracer_pid;
+			__kernel_pid_t tracer_tgid;
+		} ptrace;
+
+		struct comm_proc_event {
+			__kernel_pid_t process_pid;
+			__kernel_pid_t process_tgid;
+			char           comm[16];
+		} comm;
+
+		struct coredump_proc_event {
+			__kernel_pid_t process_pid;
+			__kernel_pid_t process_tgid;
+			__kernel_pid_t parent_pid;
+			__kernel_pid_t parent_tgid;
+		} coredump;
+
+		struct exit_proc_event {
+			__kernel_pid_t process_pid;
+			__kernel_pid_t process_tgid;
+			__u32 exit_code, exit_signal;
+			__kernel_pid_t parent_pid;
+			__kernel_pid_t parent_tgid;
+		} exit;
+
+	} event_data;
+};
+
+inline size_t proconn_event_header_size()
+{
+    proconn_event evt;
+    return sizeof(evt.what) +
+           sizeof(evt.cpu) +
+           sizeof(evt.timestamp_ns);
+}
+
+} // namespace impl
+} // namespace rci
+
+#endif // RCI_PROCONN_EVENT_HPP
@@ -0,0 +1,124 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_REORDER_WINDOW_HPP
+#define RCI_REORDER_WINDOW_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include <utility>
+#include <vector>
+
+#include "rci/proconn_base.hpp"
+
+namespace rci {
+
+// Restores the order of events coming from different CPUs.
+// Events are held for a bounded window and released sorted by their
+// timestamps. The events of every CPU already arrive in order, so instead of
+// sorting, the window merges the per-CPU runs through a heap of their oldest
+// events, at O(log cpus) per event. Events are held in a single slab of
+// slots, linked into the runs. The slab is allocated upfront for max_events,
+// and only grows when more are pushed between two releases.
+class reorder_window
+{
+public:
+    typedef impl::proconn_base::event event;
+
+    struct stats
+    {
+        size_t held;       // Events currently held
+        uint64_t released; // Events released in order
+        uint64_t late;     // Events older than some event already released
+        uint64_t evicted;  // Events released early, as the window was full
+    };
+
+public:
+    // Events are held until window_ns passed since they happened, but no
+    // more than max_events are held at once
+    reorder_window(uint64_t window_ns, size_t max_events);
+
+    // Hold an event. Returns false, leaving the event to the caller, for
+    // late events, older than some event that was already released.
+    bool push(const event& evt);
+
+    // Append the events that are due at now_ns (a CLOCK_MONOTONIC time, like
+    // the timestamps) to out, in timestamp order. Returns the number of
+    // events released.
+    size_t release(uint64_t now_ns, std::vector<event>& out);
+
+    // Release all held events
+    size_t flush(std::vector<event>& out);
+
+    // Timestamp of the newest event pushed
+    uint64_t newest() const;
+
+    uint64_t window() const;
+
+    size_t held() const;
+
+    // Safe to call from any thread
+    stats statistics() const;
+
+private:
+    static const uint32_t NONE = UINT32_MAX;
+
+    // A held event, linked to the next newer event of its CPU, or to the
+    // next free slot
+    struct slot
+    {
+        event evt;
+        uint32_t next;
+    };
+
+    // Events of a single CPU, as slots from oldest to newest
+    struct run
+    {
+        uint32_t oldest;
+        uint32_t newest;
+    };
+
+    // The oldest event of a run: Its timestamp and CPU
+    typedef std::pair<uint64_t, uint32_t> head;
+
+    uint32_t allocate(const event& evt);
+    void grow();
+    void insert(run& events, uint32_t index);
+    void pop_oldest(std::vector<event>& out);
+
+private:
+    const uint64_t _window_ns;
+    const size_t _max_events;
+
+    std::vector<slot> _slots;
+    uint32_t _free; // First free slot
+
+    std::vector<run> _runs;
+    std::vector<head> _heads; // Min-heap, one entry per non-empty run
+
+    uint64_t _newest;
+    uint64_t _released_until; // Timestamp of the last event released
+
+    std::atomic<size_t> _held;
+    std::atomic<uint64_t> _released;
+    std::atomic<uint64_t> _late;
+    std::atomic<uint64_t> _evicted;
+};
+
+} // namespace rci
+
+#endif // RCI_REORDER_WINDOW_HPP
@@ -0,0 +1,163 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_SPSC_RING_HPP
+#define RCI_SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace rci {
+
+// A bounded, lock-free, single-producer single-consumer ring of trivially
+// copyable items. All slots are allocated up front.
+// The producer and consumer indexes are kept on separate cache lines, and
+// each side caches the other's index, so that in the common case pushing
+// and popping don't touch the other side's cache line at all.
+template <typename T>
+class spsc_ring
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "spsc_ring items must be trivially copyable");
+
+public:
+    // The capacity is rounded up to a power of two
+    explicit spsc_ring(size_t capacity)
+        : _slots(round_up(capacity)), _mask(_slots.size() - 1),
+          _producer(), _consumer()
+    {}
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    size_t capacity() const { return _slots.size(); }
+
+    // Approximate when called by neither the producer nor the consumer
+    size_t size() const
+    {
+        return _producer.index.load(std::memory_order_acquire) -
+               _consumer.index.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // Producer: Push up to count items, publishing them all at once.
+    // Returns the number of items pushed, less than count if full.
+    size_t push(const T* items, size_t count)
+    {
+        size_t tail  = _producer.index.load(std::memory_order_relaxed);
+        size_t& head = _producer.other;
+
+        size_t free = capacity() - (tail - head);
+        if (free < count)
+        {
+            head = _consumer.index.load(std::memory_order_acquire);
+            free = capacity() - (tail - head);
+        }
+
+        count = std::min(count, free);
+        for (size_t i = 0; i < count; ++i)
+        {
+            _slots[(tail + i) & _mask] = items[i];
+        }
+
+        _producer.index.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    bool push(const T& item) { return push(&item, 1) == 1; }
+
+    // Consumer: Point first at the oldest items, without removing them.
+    // Returns the number of items that are contiguous in memory, which can
+    // be less than size() when the items wrap around the end of the ring.
+    size_t peek(const T*& first)
+    {
+        size_t head  = _consumer.index.load(std::memory_order_relaxed);
+        size_t& tail = _consumer.other;
+
+        if (head == tail)
+        {
+            tail = _producer.index.load(std::memory_order_acquire);
+            if (head == tail)
+            {
+                return 0;
+            }
+        }
+
+        size_t index = head & _mask;
+        first        = &_slots[index];
+        return std::min(tail - head, capacity() - index);
+    }
+
+    // Consumer: Remove count items, previously returned by peek()
+    void consume(size_t count)
+    {
+        _consumer.index.store(
+            _consumer.index.load(std::memory_order_relaxed) + count,
+            std::memory_order_release);
+    }
+
+    bool pop(T& item)
+    {
+        const T* first = nullptr;
+        if (peek(first) == 0)
+        {
+            return false;
+        }
+
+        item = *first;
+        consume(1);
+        return true;
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    // The index written by one side, and that side's cached copy of the
+    // other side's index, padded to sit on a cache line of their own
+    struct side
+    {
+        char pad_front[CACHE_LINE];
+        std::atomic<size_t> index{0};
+        size_t other = 0;
+        char pad_back[CACHE_LINE - sizeof(std::atomic<size_t>) -
+                      sizeof(size_t)];
+    };
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    std::vector<T> _slots;
+    const size_t _mask;
+
+    side _producer; // Index of the next slot to push into
+    side _consumer; // Index of the next slot to pop from
+};
+
+} // namespace rci
+
+#endif // RCI_SPSC_RING_HPP
@@ -0,0 +1,146 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_THREAD_COALESCER_HPP
+#define RCI_THREAD_COALESCER_HPP
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rci/proconn_base.hpp"
+
+namespace rci {
+
+// Sheds the churn of short-lived threads, e.g. those of thread pools.
+// The fork of a thread is held for a bounded window, along with any event
+// of the thread that follows it. If the thread exits within the window, all
+// of its events are dropped. Otherwise they are released as they were, so
+// long-lived threads are only delayed. Events of processes (tid == pid) are
+// never held.
+//
+// Instead of the dropped events, the forks and exits of threads are counted
+// per process, to be reported periodically.
+//
+// The events of all held threads share a single slab of slots, allocated
+// upfront for max_threads and linked per thread, which only grows when the
+// held threads have more events than that.
+class thread_coalescer
+{
+public:
+    typedef impl::proconn_base::event event;
+
+    // Threads a process spawned and that exited, since the last report
+    struct churn
+    {
+        pid_t pid;
+        uint64_t spawned;
+        uint64_t exited;
+    };
+
+    struct stats
+    {
+        size_t held;        // Threads currently held
+        uint64_t coalesced; // Threads dropped, as they exited in time
+        uint64_t passed;    // Threads released, as they lived longer
+    };
+
+public:
+    // Threads are held until window_ns passed since their fork, but no more
+    // than max_threads are held at once
+    thread_coalescer(uint64_t window_ns, size_t max_threads);
+
+    // Pass an event through, appending the events to deliver now to out
+    void push(const event& evt, std::vector<event>& out);
+
+    // Append the events of the threads that lived longer than the window at
+    // now_ns to out, oldest thread first. Returns the number of threads
+    // released.
+    size_t release(uint64_t now_ns, std::vector<event>& out);
+
+    // Release all held threads
+    size_t flush(std::vector<event>& out);
+
+    // Append the counters of every process with threads spawned or exited
+    // since the last report to out, and reset them. Returns the number of
+    // processes reported.
+    size_t report(std::vector<churn>& out);
+
+    uint64_t window() const;
+
+    size_t held() const;
+
+    // Whether any counters wait to be reported
+    bool pending() const;
+
+    // Safe to call from any thread
+    stats statistics() const;
+
+private:
+    static const uint32_t NONE = UINT32_MAX;
+
+    // A held event, linked to the next event of its thread, or to the next
+    // free slot
+    struct slot
+    {
+        event evt;
+        uint32_t next;
+    };
+
+    // The events of a held thread, as slots starting with its fork
+    struct thread
+    {
+        uint64_t forked_ns;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    // Forks in the order they were held: Their timestamp and thread id.
+    // Entries of threads that are no longer held are skipped.
+    typedef std::pair<uint64_t, pid_t> fork_entry;
+
+    uint32_t allocate(const event& evt);
+    void grow();
+    void discard(const thread& held);
+    void hold(const event& evt, std::vector<event>& out);
+    bool release_entry(const fork_entry& entry, std::vector<event>& out);
+    void release_thread(pid_t tid, std::vector<event>& out);
+
+private:
+    const uint64_t _window_ns;
+    const size_t _max_threads;
+
+    std::vector<slot> _slots;
+    uint32_t _free; // First free slot
+
+    std::unordered_map<pid_t, thread> _threads;
+    std::deque<fork_entry> _forks;
+    std::unordered_map<pid_t, churn> _churn;
+
+    std::atomic<size_t> _held;
+    std::atomic<uint64_t> _coalesced;
+    std::atomic<uint64_t> _passed;
+};
+
+} // namespace rci
+
+#endif // RCI_THREAD_COALESCER_HPP
@@ -0,0 +1,223 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef RCI_THREADED_PROCONN_HPP
+#define RCI_THREADED_PROCONN_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "rci/notifier.hpp"
+#include "rci/proconn.hpp"
+#include "rci/proconn_base.hpp"
+#include "rci/spsc_ring.hpp"
+
+namespace rci {
+
+// A proc connector listener that keeps user code out of the receive path:
+// A dedicated reader thread only drains the socket, decoding the events into
+// a preallocated lock-free ring, and the callbacks are called on a separate
+// consumer thread, so slow callbacks can't make the kernel drop events.
+//
+// With queue_options::workers, the events are sharded by process between
+// that many worker threads, each with a ring of its own. The events of a
+// process are always handled by the same worker, in order. A fork is
+// handled by the worker of the child process, so it's always handled before
+// any event of the child. Callbacks must be thread-safe in that mode.
+//
+// The lost and gap callbacks are called on the reader thread, views are not
+// supported, as events outlive the receive buffer.
+class threaded_proconn final : public impl::proconn_base
+{
+public:
+    typedef proconn::event_callbacks event_callbacks;
+
+    // What the reader does when a ring is full
+    enum class backpressure
+    {
+        // Wait for the consumer, leaving the socket queue to absorb the
+        // burst, where the kernel drops events once it overflows
+        block,
+
+        // Drop the events that don't fit
+        drop_newest,
+
+        // Keep the events that don't fit aside, and have the consumer skip
+        // as many of the oldest queued events to make room for them
+        drop_oldest,
+
+        // Keep the events that don't fit aside, and fold the complete life
+        // of short-lived threads (fork, exit and anything in between) into
+        // nothing. Blocks once a whole ring worth of events is kept aside.
+        coalesce,
+    };
+
+    struct queue_options
+    {
+        // Number of events the ring holds, rounded up to a power of two
+        size_t capacity = 4096;
+
+        // Ring depth counted as a high-water crossing, 0 disables
+        size_t high_water = 0;
+
+        // Number of worker threads run() dispatches on, each with a ring of
+        // the given capacity. 0 dispatches on the thread calling run() or
+        // consume().
+        size_t workers = 0;
+
+        backpressure policy = backpressure::block;
+    };
+
+    struct queue_stats
+    {
+        size_t capacity;     // Number of events the ring holds
+        size_t depth;        // Events currently queued
+        size_t max_depth;    // Deepest the ring has been
+        uint64_t published;  // Events the reader queued
+        uint64_t full;       // Times the reader found the ring full
+        uint64_t high_water; // Times the depth reached the high-water mark
+
+        // Per backpressure policy
+        uint64_t blocked;        // Times the reader waited for the consumer
+        uint64_t dropped_newest; // Events dropped as they didn't fit
+        uint64_t dropped_oldest; // Queued events dropped to make room
+        uint64_t coalesced;      // Events folded away
+        size_t backlog;          // Events kept aside, waiting for room
+    };
+
+public:
+    explicit threaded_proconn(event_callbacks callbacks);
+    threaded_proconn(event_callbacks callbacks, const options& opts);
+    threaded_proconn(event_callbacks callbacks, const options& opts,
+                     const queue_options& queue);
+    ~threaded_proconn();
+
+    // Start the reader thread, and consume events on the calling thread, or
+    // on the worker threads, until stop() is called.
+    // Rethrows errors of the reader thread and of the callbacks.
+    void run();
+
+    // Pulled mode, without workers: Start the reader thread using
+    // start_reader(), wait for ready_fd() to become readable and call
+    // consume() to dispatch the queued events on the calling thread.
+
+    void start_reader();
+
+    // Readable whenever events are queued
+    int ready_fd() const;
+
+    // Dispatch up to max_events queued events without blocking. Returns the
+    // number of events dispatched. Rethrows errors of the reader thread.
+    size_t consume(size_t max_events = std::numeric_limits<size_t>::max());
+
+    // Makes run() return at once, stops the reader and worker threads and
+    // unregisters from the kernel. Events still queued are discarded.
+    // Errors, of any thread, stop the listener as well.
+    // Safe to call from any thread, including from the callbacks.
+    void stop();
+
+    // Number of rings, one per worker, at least one
+    size_t shards() const;
+
+    // Safe to call from any thread.
+    // Totals over all shards, or the statistics of a single shard.
+    queue_stats queue_statistics() const;
+    queue_stats queue_statistics(size_t shard) const;
+
+private:
+    // A ring and its consumer
+    struct shard
+    {
+        explicit shard(size_t capacity);
+
+        spsc_ring<event> ring;
+        std::thread worker;
+
+        // Events being published, starting with those kept aside earlier
+        std::vector<event> staged;
+        std::atomic<size_t> backlog;
+
+        // Threads seen by coalesce(), kept to reuse its buckets
+        std::unordered_map<pid_t, bool> threads;
+
+        // Ready: Events were queued, or the consumer should stop
+        // Space: Events were consumed, making room in the ring
+        impl::notifier ready;
+        impl::notifier space;
+
+        bool above_high_water;
+        std::atomic<size_t> max_depth;
+        std::atomic<uint64_t> published;
+        std::atomic<uint64_t> full;
+        std::atomic<uint64_t> high_water;
+        std::atomic<uint64_t> blocked;
+        std::atomic<uint64_t> dropped_newest;
+        std::atomic<uint64_t> dropped_oldest;
+        std::atomic<uint64_t> coalesced;
+    };
+
+    void on_lost(uint64_t overruns) override;
+    void on_gap(uint32_t cpu, uint64_t missed) override;
+
+    void read();
+    void publish(const raw_event* events, size_t count);
+    void publish(shard& target);
+    size_t wait_for_space(shard& target, size_t pushed);
+    void coalesce(shard& target);
+    void discard_oldest(shard& source);
+    void track_depth(shard& target);
+    size_t route(const event& evt) const;
+
+    void work(shard& source);
+    size_t consume(shard& source, size_t max_events);
+    void deliver(const event* events, size_t count, size_t& delivered);
+
+    void fail(std::exception_ptr error);
+    void join();
+    void rethrow_error();
+
+private:
+    event_callbacks _callbacks;
+    uint32_t _mask;
+    queue_options _queue_options;
+
+    std::vector<std::unique_ptr<shard>> _shards;
+
+    // Notified by consumers making room while events are kept aside
+    impl::notifier _drained;
+
+    std::thread _reader;
+
+    // Set by the first thread that fails, with the error run() rethrows
+    std::atomic<bool> _failed;
+    std::mutex _error_lock;
+    std::exception_ptr _error;
+
+    // Notified when a thread fails, to wake up run()
+    impl::notifier _done;
+};
+
+} // namespace rci
+
+#endif // RCI_THREADED_PROCONN_HPP
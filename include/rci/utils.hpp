@@ -24,6 +24,10 @@ namespace utils {
 // Get the current thread ID
 pid_t gettid();
 
+// Get the version of the running kernel, encoded like KERNEL_VERSION(a,b,c)
+// from <linux/version.h>, or 0 if it can't be parsed
+unsigned kernel_version();
+
 } // namespace utils
 } // namespace impl
 } // namespace rci
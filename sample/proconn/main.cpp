@@ -74,6 +74,11 @@ void exit_callback(rci::proconn::exit_event evt)
     }
 }
 
+void lost_callback(uint64_t overruns)
+{
+    LOG("events lost, total overruns: " << overruns);
+}
+
 int run_proconn(std::vector<std::string>&& args)
 {
     (void)args;
@@ -85,8 +90,13 @@ int run_proconn(std::vector<std::string>&& args)
     callbacks.gid    = gid_callback;
     callbacks.ptrace = ptrace_callback;
     callbacks.exit   = exit_callback;
+    callbacks.lost   = lost_callback;
+
+    rci::proconn::options options;
+    options.recv_batch = 64;
+    options.overrun    = rci::proconn::overrun_policy::report;
 
-    rci::proconn pc(callbacks);
+    rci::proconn pc(callbacks, options);
     pc.run();
 
     return 0;
@@ -0,0 +1,323 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "rci/broadcast_proconn.hpp"
+
+namespace rci {
+
+using namespace impl;
+
+// Number of events an overwriting consumer copies out at once
+static const size_t READ_BATCH = 256;
+
+broadcast_proconn::subscriber::subscriber(const consumer& config,
+                                          size_t index)
+    : config(config), index(index), delivered(0)
+{
+    if (config.policy == broadcast_policy::overwrite)
+    {
+        copies.resize(READ_BATCH);
+    }
+}
+
+broadcast_proconn::broadcast_proconn(std::vector<consumer> consumers)
+    : broadcast_proconn(consumers, options())
+{
+    // Do nothing
+}
+
+broadcast_proconn::broadcast_proconn(std::vector<consumer> consumers,
+                                     const options& opts, size_t capacity)
+    : proconn_base(opts, consumers_mask(consumers)),
+      _mask(consumers_mask(consumers)), _ring(capacity), _blocked(0)
+{
+    for (const auto& config : consumers)
+    {
+        size_t index = _ring.add_consumer(config.policy);
+        _subscribers.emplace_back(new subscriber(config, index));
+    }
+
+    _decoded.reserve(opts.recv_batch);
+}
+
+broadcast_proconn::~broadcast_proconn()
+{
+    try
+    {
+        stop();
+    }
+    catch (...)
+    {
+        // Destructors must not throw
+    }
+
+    join();
+}
+
+void broadcast_proconn::run()
+{
+    for (auto& reader : _subscribers)
+    {
+        if (!reader->thread.joinable())
+        {
+            reader->thread = std::thread(&broadcast_proconn::work, this,
+                                         std::ref(*reader));
+        }
+    }
+
+    try
+    {
+        receive_loop([this](const raw_event* events, size_t count) {
+            publish(events, count);
+        });
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+
+    stop();
+    join();
+    rethrow_error();
+}
+
+void broadcast_proconn::stop()
+{
+    proconn_base::stop();
+
+    _space.notify();
+    for (auto& reader : _subscribers)
+    {
+        reader->ready.notify();
+    }
+}
+
+broadcast_proconn::ring_stats broadcast_proconn::ring_statistics() const
+{
+    ring_stats snapshot;
+    snapshot.capacity  = _ring.capacity();
+    snapshot.published = _ring.published();
+    snapshot.blocked   = _blocked.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+broadcast_proconn::consumer_stats
+broadcast_proconn::consumer_statistics(size_t index) const
+{
+    const auto& reader = *_subscribers.at(index);
+
+    consumer_stats snapshot;
+    snapshot.delivered = reader.delivered.load(std::memory_order_relaxed);
+    snapshot.lost      = _ring.lost(reader.index);
+    snapshot.lag       = _ring.lag(reader.index);
+    return snapshot;
+}
+
+uint32_t broadcast_proconn::consumers_mask(
+    const std::vector<consumer>& consumers)
+{
+    uint32_t mask = 0;
+    for (const auto& config : consumers)
+    {
+        mask |= proconn::event_mask(config.callbacks);
+    }
+    return mask;
+}
+
+void broadcast_proconn::on_lost(uint64_t overruns)
+{
+    if (!_subscribers.empty() && _subscribers.front()->config.callbacks.lost)
+    {
+        _subscribers.front()->config.callbacks.lost(overruns);
+    }
+}
+
+void broadcast_proconn::on_gap(uint32_t cpu, uint64_t missed)
+{
+    if (!_subscribers.empty() && _subscribers.front()->config.callbacks.gap)
+    {
+        _subscribers.front()->config.callbacks.gap(cpu, missed);
+    }
+}
+
+void broadcast_proconn::publish(const raw_event* events, size_t count)
+{
+    _decoded.resize(count);
+
+    size_t decoded = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Only publish the event types some consumer receives
+        if (events[i].data->what & _mask &&
+            decode(events[i], _decoded[decoded]))
+        {
+            ++decoded;
+        }
+    }
+
+    size_t pushed = _ring.push(_decoded.data(), decoded);
+    if (pushed < decoded)
+    {
+        _blocked.fetch_add(1, std::memory_order_relaxed);
+
+        // Wait for the slowest blocking consumer
+        while (true)
+        {
+            _space.clear();
+            pushed += _ring.push(_decoded.data() + pushed, decoded - pushed);
+            if (pushed == decoded || stopping())
+            {
+                break;
+            }
+
+            for (auto& reader : _subscribers)
+            {
+                reader->ready.notify();
+            }
+            _space.wait();
+        }
+    }
+
+    if (pushed)
+    {
+        for (auto& reader : _subscribers)
+        {
+            reader->ready.notify();
+        }
+    }
+}
+
+void broadcast_proconn::work(subscriber& reader)
+{
+    try
+    {
+        while (!stopping())
+        {
+            reader.ready.clear();
+            if (read(reader) == 0 && !stopping())
+            {
+                reader.ready.wait();
+            }
+        }
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+}
+
+size_t broadcast_proconn::read(subscriber& reader)
+{
+    size_t total = 0;
+    while (!stopping())
+    {
+        size_t count = 0;
+        if (reader.config.policy == broadcast_policy::block)
+        {
+            const event* first = nullptr;
+            count = _ring.peek(reader.index, first);
+            if (count)
+            {
+                deliver(reader, first, count);
+                _ring.consume(reader.index, count);
+                _space.notify();
+            }
+        }
+        else
+        {
+            count = _ring.read(reader.index, reader.copies.data(),
+                               reader.copies.size());
+            if (count)
+            {
+                deliver(reader, reader.copies.data(), count);
+            }
+        }
+
+        if (count == 0)
+        {
+            break;
+        }
+        total += count;
+    }
+
+    return total;
+}
+
+void broadcast_proconn::deliver(subscriber& reader, const event* events,
+                                size_t count)
+{
+    const auto& callbacks = reader.config.callbacks;
+    for (size_t i = 0; i < count; ++i)
+    {
+        proconn::deliver(callbacks, events[i]);
+    }
+
+    if (callbacks.batch)
+    {
+        callbacks.batch(events, count);
+    }
+
+    reader.delivered.fetch_add(count, std::memory_order_relaxed);
+}
+
+void broadcast_proconn::fail(std::exception_ptr error)
+{
+    {
+        std::lock_guard<std::mutex> lock(_error_lock);
+        if (!_error)
+        {
+            _error = error;
+        }
+    }
+
+    try
+    {
+        stop();
+    }
+    catch (...)
+    {
+        // The first error is the one reported
+    }
+}
+
+void broadcast_proconn::join()
+{
+    for (auto& reader : _subscribers)
+    {
+        if (reader->thread.joinable())
+        {
+            reader->thread.join();
+        }
+    }
+}
+
+void broadcast_proconn::rethrow_error()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(_error_lock);
+        std::swap(error, _error);
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace rci
@@ -0,0 +1,257 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <system_error>
+
+#include "rci/exec_enricher.hpp"
+
+namespace rci {
+
+namespace {
+
+int pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Whether the process pinned by the pidfd is still alive
+bool pidfd_alive(int pidfd)
+{
+#ifdef SYS_pidfd_send_signal
+    return syscall(SYS_pidfd_send_signal, pidfd, 0, NULL, 0) == 0;
+#else
+    (void)pidfd;
+    return true;
+#endif
+}
+
+} // anonymous namespace
+
+std::vector<std::string> exec_enricher::exec_info::args() const
+{
+    std::vector<std::string> out;
+
+    const char* arg = cmdline.data;
+    const char* end = cmdline.data + cmdline.size;
+    while (arg < end)
+    {
+        size_t size = strnlen(arg, end - arg);
+        out.emplace_back(arg, size);
+        arg += size + 1;
+    }
+
+    return out;
+}
+
+exec_enricher::exec_enricher(callback enriched)
+    : exec_enricher(enriched, options())
+{
+    // Do nothing
+}
+
+exec_enricher::exec_enricher(callback enriched, const options& opts)
+    : _enriched(enriched), _proc_fd(-1), _pidfd_supported(true),
+      _path_prefix(0), _truncated(false), _exe(opts.exe_max),
+      _cmdline(opts.cmdline_max), _cwd(opts.cwd_max), _execs(0), _gone(0),
+      _truncated_texts(0), _denied(0), _unpinned(0)
+{
+    _proc_fd = open(opts.proc_root.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (_proc_fd == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't open " + opts.proc_root);
+    }
+}
+
+exec_enricher::~exec_enricher()
+{
+    close(_proc_fd);
+}
+
+void exec_enricher::attach(proconn::event_callbacks& callbacks)
+{
+    auto exec      = std::move(callbacks.exec);
+    callbacks.exec = [this, exec](proconn::exec_event evt) {
+        enrich(evt.meta, evt.process);
+        if (exec)
+        {
+            exec(evt);
+        }
+    };
+}
+
+void exec_enricher::enrich(const metadata& meta, const task_ids& process)
+{
+    exec_info info;
+    memset(&info, 0, sizeof(info));
+    info.meta    = meta;
+    info.process = process;
+
+    _execs.fetch_add(1, std::memory_order_relaxed);
+    _truncated = false;
+
+    // Pin the process first, so its pid can't be reused unnoticed
+    int pidfd = -1;
+    if (_pidfd_supported)
+    {
+        pidfd = pidfd_open(process.pid);
+        if (pidfd == -1 && errno == ENOSYS)
+        {
+            _pidfd_supported = false;
+        }
+        else if (pidfd == -1 && errno == ESRCH)
+        {
+            info.gone = true;
+        }
+    }
+
+    // Out of descriptors or the like, read it unpinned this time
+    if (pidfd == -1 && !info.gone)
+    {
+        _unpinned.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (!info.gone)
+    {
+        int size = snprintf(_path, sizeof(_path), "%d/", process.pid);
+        _path_prefix = size;
+
+        // Exited processes, zombies included, have no executable
+        info.gone = !read_link("exe", _exe, info.exe) ||
+                    !read_file("cmdline", _cmdline, info.cmdline) ||
+                    !read_link("cwd", _cwd, info.cwd);
+    }
+
+    if (pidfd != -1)
+    {
+        info.gone = info.gone || !pidfd_alive(pidfd);
+        close(pidfd);
+    }
+
+    if (info.gone)
+    {
+        _gone.fetch_add(1, std::memory_order_relaxed);
+        info.exe = info.cmdline = info.cwd = text();
+    }
+    else
+    {
+        info.truncated = _truncated;
+    }
+
+    _enriched(info);
+}
+
+exec_enricher::stats exec_enricher::statistics() const
+{
+    stats snapshot;
+    snapshot.execs     = _execs.load(std::memory_order_relaxed);
+    snapshot.gone      = _gone.load(std::memory_order_relaxed);
+    snapshot.truncated = _truncated_texts.load(std::memory_order_relaxed);
+    snapshot.denied    = _denied.load(std::memory_order_relaxed);
+    snapshot.unpinned  = _unpinned.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+bool exec_enricher::read_link(const char* name, std::vector<char>& buffer,
+                              text& out)
+{
+    snprintf(_path + _path_prefix, sizeof(_path) - _path_prefix, "%s", name);
+
+    ssize_t size = readlinkat(_proc_fd, _path, buffer.data(), buffer.size());
+    if (size < 0)
+    {
+        return record(errno);
+    }
+
+    if (static_cast<size_t>(size) == buffer.size())
+    {
+        _truncated = true;
+        _truncated_texts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    out.data = buffer.data();
+    out.size = size;
+    return true;
+}
+
+bool exec_enricher::read_file(const char* name, std::vector<char>& buffer,
+                              text& out)
+{
+    snprintf(_path + _path_prefix, sizeof(_path) - _path_prefix, "%s", name);
+
+    int fd = openat(_proc_fd, _path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return record(errno);
+    }
+
+    // The arguments may take more than a single read
+    size_t size = 0;
+    while (size < buffer.size())
+    {
+        ssize_t bytes = read(fd, buffer.data() + size, buffer.size() - size);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            break;
+        }
+        size += bytes;
+    }
+
+    char extra;
+    if (size == buffer.size() && read(fd, &extra, 1) == 1)
+    {
+        _truncated = true;
+        _truncated_texts.fetch_add(1, std::memory_order_relaxed);
+    }
+    close(fd);
+
+    out.data = buffer.data();
+    out.size = size;
+    return true;
+}
+
+// Returns false if the failure means the process is gone
+bool exec_enricher::record(int error)
+{
+    if (error == EACCES || error == EPERM)
+    {
+        _denied.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Out of descriptors or memory, the text is left empty
+    return error != ENOENT && error != ESRCH;
+}
+
+} // namespace rci
@@ -0,0 +1,97 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+
+#include <system_error>
+
+#include "rci/notifier.hpp"
+
+namespace rci {
+namespace impl {
+
+notifier::notifier()
+    : _fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), _notified(false)
+{
+    if (_fd == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't create notifier event");
+    }
+}
+
+notifier::~notifier()
+{
+    close(_fd);
+}
+
+int notifier::fd() const
+{
+    return _fd;
+}
+
+void notifier::notify()
+{
+    if (_notified.exchange(true))
+    {
+        return; // Still readable since the last notification
+    }
+
+    uint64_t value = 1;
+    while (write(_fd, &value, sizeof(value)) < 0 && errno == EINTR)
+        ;
+}
+
+void notifier::clear()
+{
+    // Drain before resetting the flag, or a notify() in between is drained
+    // while the flag stays set, and no later notify() writes again. The
+    // exchange acquires whatever that notify() published.
+    uint64_t value;
+    while (read(_fd, &value, sizeof(value)) < 0 && errno == EINTR)
+        ;
+
+    _notified.exchange(false, std::memory_order_acq_rel);
+}
+
+bool notifier::wait(int timeout_ms)
+{
+    struct pollfd pfd = {_fd, POLLIN, 0};
+
+    while (true)
+    {
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (ready < 0)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Couldn't wait for notification");
+        }
+
+        return ready > 0;
+    }
+}
+
+} // namespace impl
+} // namespace rci
@@ -0,0 +1,304 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <system_error>
+#include <thread>
+
+#include "rci/proc_scan.hpp"
+
+namespace rci {
+namespace impl {
+
+namespace {
+
+// A process as found in /proc, before converting its start time
+struct scanned
+{
+    pid_t pid;
+    pid_t parent;
+    uint64_t start_ticks; // Clock ticks since boot
+    char comm[16];
+};
+
+uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+// Parse the null-terminated contents of /proc/<pid>/stat, where the name,
+// in parentheses, may hold spaces and parentheses of its own
+bool parse_stat(const char* data, scanned& out)
+{
+    const char* open  = strchr(data, '(');
+    const char* close = strrchr(data, ')');
+    if (!open || !close || close < open)
+    {
+        return false;
+    }
+
+    memset(&out, 0, sizeof(out));
+    out.pid = strtol(data, NULL, 10);
+    memcpy(out.comm, open + 1,
+           std::min<size_t>(close - open - 1, sizeof(out.comm)));
+
+    // The fields that follow the name, starting with the state (field 3)
+    const char* field = close + 1;
+    for (int index = 0; *field; ++index)
+    {
+        while (*field == ' ')
+        {
+            ++field;
+        }
+
+        if (index == 1)
+        {
+            out.parent = strtol(field, NULL, 10);
+        }
+        else if (index == 19)
+        {
+            out.start_ticks = strtoull(field, NULL, 10);
+            return true;
+        }
+
+        while (*field && *field != ' ')
+        {
+            ++field;
+        }
+    }
+
+    return false;
+}
+
+void list_pids(int proc_fd, std::vector<pid_t>& out)
+{
+    int fd = dup(proc_fd);
+    DIR* dir = fd == -1 ? NULL : fdopendir(fd);
+    if (!dir)
+    {
+        int error = errno;
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        throw std::system_error(error, std::system_category(),
+                                "Couldn't list processes");
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char* end = NULL;
+        long pid  = strtol(entry->d_name, &end, 10);
+        if (pid > 0 && *end == '\0')
+        {
+            out.push_back(static_cast<pid_t>(pid));
+        }
+    }
+
+    closedir(dir);
+}
+
+// Scan some of the processes, with a single reused buffer, opening their
+// files relative to the /proc directory
+void scan_range(int proc_fd, const pid_t* pids, size_t count,
+                std::vector<scanned>& out)
+{
+    char path[32];
+    char buffer[1024];
+    scanned found;
+
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        snprintf(path, sizeof(path), "%d/stat", pids[i]);
+        int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            continue; // Exited since it was listed
+        }
+
+        ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (size <= 0)
+        {
+            continue;
+        }
+
+        buffer[size] = '\0';
+        if (parse_stat(buffer, found))
+        {
+            out.push_back(found);
+        }
+    }
+}
+
+// Scan on a worker thread, keeping the failure for the caller to rethrow
+void scan_worker(int proc_fd, const pid_t* pids, size_t count,
+                 std::vector<scanned>& out, std::exception_ptr& error)
+{
+    try
+    {
+        scan_range(proc_fd, pids, count, out);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+}
+
+void join_all(std::vector<std::thread>& workers)
+{
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+} // anonymous namespace
+
+uint64_t monotonic_ns()
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+uint64_t suspended_ns()
+{
+    // Reading both clocks leaves some jitter: Only moves beyond the precision
+    // of /proc are followed, so that moved timestamps keep their order
+    static const uint64_t tick_ns = proc_tick_ns();
+    static std::atomic<uint64_t> last(0);
+
+    uint64_t monotonic = clock_ns(CLOCK_MONOTONIC);
+    uint64_t boottime  = clock_ns(CLOCK_BOOTTIME);
+    uint64_t suspended = boottime > monotonic ? boottime - monotonic : 0;
+
+    uint64_t known = last.load(std::memory_order_relaxed);
+    if (suspended > known + tick_ns)
+    {
+        last.store(suspended, std::memory_order_relaxed);
+        return suspended;
+    }
+    return known;
+}
+
+uint64_t proc_tick_ns()
+{
+    return 1000000000 / sysconf(_SC_CLK_TCK);
+}
+
+void scan_proc(const std::string& proc_root, size_t threads,
+               std::vector<proc_entry>& out)
+{
+    int proc_fd = open(proc_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (proc_fd == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't open " + proc_root);
+    }
+
+    std::vector<pid_t> pids;
+    std::vector<std::vector<scanned>> found;
+    try
+    {
+        list_pids(proc_fd, pids);
+
+        // Small scans aren't worth a thread
+        if (threads == 0)
+        {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        threads = std::min(threads, pids.size() / 1024 + 1);
+
+        size_t chunk = (pids.size() + threads - 1) / threads;
+        found.resize(threads);
+
+        std::vector<std::exception_ptr> errors(threads);
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        try
+        {
+            for (size_t i = 1; i < threads; ++i)
+            {
+                size_t first = std::min(i * chunk, pids.size());
+                size_t count = std::min(chunk, pids.size() - first);
+                workers.emplace_back(scan_worker, proc_fd,
+                                     pids.data() + first, count,
+                                     std::ref(found[i]), std::ref(errors[i]));
+            }
+
+            scan_range(proc_fd, pids.data(), std::min(chunk, pids.size()),
+                       found[0]);
+        }
+        catch (...)
+        {
+            // The started workers still use the buffers
+            join_all(workers);
+            throw;
+        }
+        join_all(workers);
+
+        for (const auto& error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+    catch (...)
+    {
+        close(proc_fd);
+        throw;
+    }
+    close(proc_fd);
+
+    uint64_t tick_ns = proc_tick_ns();
+
+    for (const auto& part : found)
+    {
+        for (const auto& process : part)
+        {
+            proc_entry entry;
+            entry.pid      = process.pid;
+            entry.parent   = process.parent;
+            entry.start_ns = process.start_ticks * tick_ns;
+
+            // A start time of 0 is left to unknown processes
+            entry.start_ns = std::max<uint64_t>(entry.start_ns, 1);
+            memcpy(entry.comm, process.comm, sizeof(entry.comm));
+            out.push_back(entry);
+        }
+    }
+}
+
+} // namespace impl
+} // namespace rci
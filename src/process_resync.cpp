@@ -0,0 +1,405 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <system_error>
+#include <unordered_map>
+
+#include "rci/process_resync.hpp"
+
+namespace rci {
+
+typedef impl::proconn_base::event_type event_type;
+
+process_resync::process_resync(process_table& table)
+    : process_resync(table, options())
+{
+    // Do nothing
+}
+
+process_resync::process_resync(process_table& table, const options& opts)
+    : _table(table), _options(opts), _tick_ns(impl::proc_tick_ns()),
+      _requested(false), _running(false), _settling(false), _started_ns(0),
+      _started_boot_ns(0), _last_start_ns(0), _newest_ns(0), _deadline_ns(0),
+      _scanned_ns(0),
+      _finished(false), _scans(0), _exits(0), _forks(0), _reparented(0)
+{
+    _timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_timer == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't create timer");
+    }
+}
+
+process_resync::~process_resync()
+{
+    if (_worker.joinable())
+    {
+        _worker.join();
+    }
+    close(_timer);
+}
+
+void process_resync::attach(proconn::event_callbacks& callbacks)
+{
+    auto lost      = std::move(callbacks.lost);
+    callbacks.lost = [this, lost](uint64_t overruns) {
+        trigger();
+        poll();
+        if (lost)
+        {
+            lost(overruns);
+        }
+    };
+
+    auto gap      = std::move(callbacks.gap);
+    callbacks.gap = [this, gap](uint32_t cpu, uint64_t missed) {
+        trigger();
+        poll();
+        if (gap)
+        {
+            gap(cpu, missed);
+        }
+    };
+
+    // Polls once the table, and the callbacks chained before it, are done.
+    // Only the events the table needs, to keep the kernel filters narrow.
+    auto fork      = std::move(callbacks.fork);
+    callbacks.fork = [this, fork](proconn::fork_event evt) {
+        touch(evt.meta, evt.child);
+        if (fork)
+        {
+            fork(evt);
+        }
+        applied(evt.meta);
+    };
+
+    auto exec      = std::move(callbacks.exec);
+    callbacks.exec = [this, exec](proconn::exec_event evt) {
+        if (exec)
+        {
+            exec(evt);
+        }
+        applied(evt.meta);
+    };
+
+    auto comm      = std::move(callbacks.comm);
+    callbacks.comm = [this, comm](proconn::comm_event evt) {
+        if (comm)
+        {
+            comm(evt);
+        }
+        applied(evt.meta);
+    };
+
+    auto exit      = std::move(callbacks.exit);
+    callbacks.exit = [this, exit](proconn::exit_event evt) {
+        touch(evt.meta, evt.process);
+        if (exit)
+        {
+            exit(evt);
+        }
+        applied(evt.meta);
+    };
+}
+
+// A process forked or exited during the scan
+void process_resync::touch(const metadata& meta, const task_ids& process)
+{
+    if (_running && meta.timestamp_ns >= _started_ns &&
+        process.tid == process.pid)
+    {
+        _touched.insert(process.pid);
+    }
+}
+
+void process_resync::applied(const metadata& meta)
+{
+    _newest_ns = std::max(_newest_ns, meta.timestamp_ns);
+    poll();
+}
+
+void process_resync::trigger()
+{
+    _requested.store(true, std::memory_order_release);
+}
+
+bool process_resync::poll()
+{
+    if (_finished.load(std::memory_order_acquire))
+    {
+        _worker.join();
+        _finished    = false;
+        _deadline_ns = 1; // Expired by the worker
+
+        if (_error)
+        {
+            _running = false;
+            arm(0);
+
+            std::exception_ptr error;
+            std::swap(error, _error);
+            std::rethrow_exception(error);
+        }
+
+        _settling = true;
+    }
+
+    bool applied         = false;
+    uint64_t deadline_ns = 0;
+    if (_settling)
+    {
+        // Events queued during the scan go first, as the scan may predate
+        // them. Once one from after the scan was applied, they all were.
+        uint64_t settled_ns = _scanned_ns + _options.settle_ns;
+        if (_newest_ns >= _scanned_ns || impl::monotonic_ns() >= settled_ns)
+        {
+            reconcile();
+            _settling = false;
+            _running  = false;
+            applied   = true;
+        }
+        else
+        {
+            deadline_ns = settled_ns;
+        }
+    }
+
+    if (!_running && _requested.load(std::memory_order_acquire))
+    {
+        // Held back by the rate limit, until the timer expires if no event
+        // polls before
+        uint64_t now_ns  = impl::monotonic_ns();
+        uint64_t next_ns = _last_start_ns + _options.min_interval_ns;
+        if (_last_start_ns == 0 || now_ns >= next_ns)
+        {
+            start(now_ns);
+        }
+        else
+        {
+            deadline_ns = next_ns;
+        }
+    }
+
+    // While scanning, the timer is left to the worker
+    if (!_running || _settling)
+    {
+        arm(deadline_ns);
+    }
+
+    return applied;
+}
+
+int process_resync::ready_fd() const
+{
+    return _timer;
+}
+
+bool process_resync::running() const
+{
+    return _running;
+}
+
+process_resync::stats process_resync::statistics() const
+{
+    stats snapshot;
+    snapshot.scans      = _scans.load(std::memory_order_relaxed);
+    snapshot.exits      = _exits.load(std::memory_order_relaxed);
+    snapshot.forks      = _forks.load(std::memory_order_relaxed);
+    snapshot.reparented = _reparented.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void process_resync::start(uint64_t now_ns)
+{
+    arm(0);
+
+    _requested.store(false, std::memory_order_relaxed);
+    _running       = true;
+    _started_ns      = now_ns;
+    _started_boot_ns = now_ns + impl::suspended_ns();
+    _last_start_ns   = now_ns;
+
+    _touched.clear();
+    _snapshot.clear();
+    _worker = std::thread(&process_resync::scan, this);
+}
+
+// An absolute deadline, 0 to disarm
+void process_resync::arm(uint64_t deadline_ns)
+{
+    if (deadline_ns == _deadline_ns)
+    {
+        return;
+    }
+
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec   = deadline_ns / 1000000000;
+    spec.it_value.tv_nsec  = deadline_ns % 1000000000;
+
+    if (timerfd_settime(_timer, TFD_TIMER_ABSTIME, &spec, NULL) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't set timer");
+    }
+
+    _deadline_ns = deadline_ns;
+}
+
+void process_resync::scan()
+{
+    try
+    {
+        impl::scan_proc(_options.proc_root, _options.threads, _snapshot);
+    }
+    catch (...)
+    {
+        _error = std::current_exception();
+    }
+
+    _scanned_ns = impl::monotonic_ns();
+    _finished.store(true, std::memory_order_release);
+
+    // Expire the timer right away, for listeners with no event to poll
+    struct itimerspec spec = {};
+    spec.it_value.tv_nsec  = 1;
+    timerfd_settime(_timer, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void process_resync::reconcile()
+{
+    _scans.fetch_add(1, std::memory_order_relaxed);
+
+    std::unordered_map<pid_t, const impl::proc_entry*> found;
+    found.reserve(_snapshot.size());
+    for (const auto& process : _snapshot)
+    {
+        found[process.pid] = &process;
+    }
+
+    // Processes gone from /proc, or replaced by others with the same pid.
+    // Processes forked during the scan may be missing from it.
+    std::vector<process_table::node> gone;
+    _table.for_each([&](const process_table::node& process) {
+        if (process.start_ns >= _started_boot_ns ||
+            _touched.count(process.pid))
+        {
+            return;
+        }
+
+        auto iter = found.find(process.pid);
+        if (iter == found.end() ||
+            !same_start(iter->second->start_ns, process.start_ns))
+        {
+            gone.push_back(process);
+        }
+    });
+
+    for (const auto& process : gone)
+    {
+        repair_exit(process);
+    }
+
+    // Parents first, so that children are linked to them
+    std::sort(_snapshot.begin(), _snapshot.end(),
+              [](const impl::proc_entry& lhs, const impl::proc_entry& rhs) {
+                  return lhs.start_ns < rhs.start_ns;
+              });
+
+    for (const auto& process : _snapshot)
+    {
+        if (_touched.count(process.pid))
+        {
+            continue; // Forked or exited during the scan
+        }
+
+        const auto* known = _table.find(process.pid);
+        if (!known)
+        {
+            repair_fork(process);
+        }
+        else if (known->parent != process.parent &&
+                 known->start_ns < _started_boot_ns)
+        {
+            _table.reparent(process.pid, process.parent);
+            _reparented.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    _touched.clear();
+    _snapshot.clear();
+}
+
+void process_resync::repair_exit(const process_table::node& process)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type              = event_type::exit;
+    evt.meta.timestamp_ns = _started_ns;
+    evt.exit.process      = {process.pid, process.pid};
+    evt.exit.parent       = {process.parent, process.parent};
+
+    _table.erase(process.pid);
+    _exits.fetch_add(1, std::memory_order_relaxed);
+
+    if (_options.repaired)
+    {
+        _options.repaired(evt);
+    }
+}
+
+void process_resync::repair_fork(const impl::proc_entry& process)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type              = event_type::fork;
+    evt.meta.timestamp_ns = monotonic_start(process.start_ns);
+    evt.fork.parent       = {process.parent, process.parent};
+    evt.fork.child        = {process.pid, process.pid};
+
+    auto& added = _table.insert(process.pid, process.parent, process.start_ns);
+    memcpy(added.comm, process.comm, sizeof(added.comm));
+    _forks.fetch_add(1, std::memory_order_relaxed);
+
+    if (_options.repaired)
+    {
+        _options.repaired(evt);
+    }
+}
+
+// The earliest the process may have been forked, as an event timestamp: Only
+// the time suspended since then must be taken off its start time, but there
+// is no telling how much of it came before the fork
+uint64_t process_resync::monotonic_start(uint64_t start_ns) const
+{
+    uint64_t suspended_ns = impl::suspended_ns();
+    return start_ns > suspended_ns ? start_ns - suspended_ns : 1;
+}
+
+// Start times in /proc are truncated to clock ticks
+bool process_resync::same_start(uint64_t lhs_ns, uint64_t rhs_ns) const
+{
+    return lhs_ns <= rhs_ns + 2 * _tick_ns && rhs_ns <= lhs_ns + 2 * _tick_ns;
+}
+
+} // namespace rci
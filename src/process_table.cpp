@@ -0,0 +1,504 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cstring>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "rci/proc_scan.hpp"
+#include "rci/process_table.hpp"
+
+namespace rci {
+
+typedef process_table::event event;
+typedef impl::proconn_base::event_type event_type;
+
+static_assert(sizeof(process_table::node) == 48, "node size changed");
+
+static size_t round_up(size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+
+static unsigned index_bits(size_t size)
+{
+    unsigned bits = 0;
+    while (size >>= 1)
+    {
+        ++bits;
+    }
+    return bits;
+}
+
+// The events the table is attached to, back in their generic form
+static event generic(const proconn::fork_event& fork)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type        = event_type::fork;
+    evt.meta        = fork.meta;
+    evt.fork.parent = fork.parent;
+    evt.fork.child  = fork.child;
+    return evt;
+}
+
+static event generic(const proconn::exec_event& exec)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type         = event_type::exec;
+    evt.meta         = exec.meta;
+    evt.exec.process = exec.process;
+    return evt;
+}
+
+static event generic(const proconn::comm_event& comm)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type         = event_type::comm;
+    evt.meta         = comm.meta;
+    evt.comm.process = comm.process;
+    memcpy(evt.comm.comm, comm.comm.data(),
+           std::min(comm.comm.size(), sizeof(evt.comm.comm)));
+    return evt;
+}
+
+static event generic(const proconn::exit_event& exit)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type             = event_type::exit;
+    evt.meta             = exit.meta;
+    evt.exit.process     = exit.process;
+    evt.exit.exit_code   = exit.exit_code;
+    evt.exit.exit_signal = exit.exit_signal;
+    evt.exit.parent      = exit.parent;
+    return evt;
+}
+
+// Call then with every event of a callback, after the callback already set
+template <typename Event, typename Then>
+static void chain(std::function<void(Event)>& callback, const Then& then)
+{
+    auto next = std::move(callback);
+    callback  = [next, then](Event evt) {
+        if (next)
+        {
+            next(evt);
+        }
+        then(generic(evt));
+    };
+}
+
+const pid_t process_table::MISSING_PID;
+
+process_table::process_table(size_t capacity)
+    : _slots(round_up(capacity)), _mask(_slots.size() - 1),
+      _shift(64 - index_bits(_slots.size())), _size(0), _scanned_until_ns(0),
+      _tick_ns(impl::proc_tick_ns())
+{
+    // Do nothing
+}
+
+void process_table::apply(const event& evt)
+{
+    switch (evt.type)
+    {
+        case event_type::fork:
+            on_fork(evt);
+            break;
+
+        case event_type::exec:
+            on_exec(evt);
+            break;
+
+        case event_type::comm:
+            on_comm(evt);
+            break;
+
+        case event_type::exit:
+            on_exit(evt);
+            break;
+
+        default:
+            break;
+    }
+}
+
+size_t process_table::bootstrap(const std::string& proc_root, size_t threads)
+{
+    std::vector<impl::proc_entry> found;
+    impl::scan_proc(proc_root, threads, found);
+
+    // Processes forked while scanning may have been found too
+    _scanned_until_ns = impl::monotonic_ns();
+
+    while ((_size + found.size()) * 2 > _slots.size())
+    {
+        grow();
+    }
+
+    size_t added = 0;
+    for (const auto& process : found)
+    {
+        if (find(process.pid))
+        {
+            continue; // Events know better
+        }
+
+        node& entry = insert(process.pid, process.parent, process.start_ns);
+        memcpy(entry.comm, process.comm, sizeof(entry.comm));
+        ++added;
+    }
+
+    // Parents may have been found after their children
+    relink();
+    return added;
+}
+
+void process_table::attach(proconn::event_callbacks& callbacks)
+{
+    auto then = [this](const event& evt) { apply(evt); };
+    chain(callbacks.fork, then);
+    chain(callbacks.exec, then);
+    chain(callbacks.comm, then);
+    chain(callbacks.exit, then);
+}
+
+void process_table::attach(proconn::event_callbacks& callbacks,
+                           keyed_callback keyed)
+{
+    auto then = [this, keyed](const event& evt) {
+        if (evt.type == event_type::fork)
+        {
+            apply(evt);
+            keyed(evt, key(evt.fork.child.pid));
+            return;
+        }
+
+        // All payloads other than fork start with the ids of the process
+        keyed(evt, key(evt.exec.process.pid));
+        apply(evt);
+    };
+    chain(callbacks.fork, then);
+    chain(callbacks.exec, then);
+    chain(callbacks.comm, then);
+    chain(callbacks.exit, then);
+}
+
+process_table::node& process_table::insert(pid_t pid, pid_t parent,
+                                           uint64_t start_ns)
+{
+    erase(pid);
+
+    if ((_size + 1) * 2 > _slots.size())
+    {
+        grow();
+    }
+
+    node& added = _slots[slot(pid)];
+    memset(&added, 0, sizeof(added));
+    added.pid      = pid;
+    added.parent   = parent;
+    added.start_ns = start_ns;
+    ++_size;
+
+    link(added);
+    return added;
+}
+
+bool process_table::erase(pid_t pid)
+{
+    size_t index = slot(pid);
+    if (_slots[index].pid == MISSING_PID)
+    {
+        return false;
+    }
+
+    node& removed = _slots[index];
+    unlink(removed);
+
+    // Orphans are reparented by the kernel, and the exit event of every
+    // child reports its new parent
+    pid_t child = removed.first_child;
+    while (child != MISSING_PID)
+    {
+        node* orphan         = lookup(child);
+        child                = orphan->next_sibling;
+        orphan->parent       = MISSING_PID;
+        orphan->next_sibling = MISSING_PID;
+        orphan->prev_sibling = MISSING_PID;
+    }
+
+    remove(index);
+    return true;
+}
+
+bool process_table::reparent(pid_t pid, pid_t parent)
+{
+    node* child = lookup(pid);
+    if (!child)
+    {
+        return false;
+    }
+
+    unlink(*child);
+    child->parent       = parent;
+    child->next_sibling = MISSING_PID;
+    child->prev_sibling = MISSING_PID;
+    link(*child);
+    return true;
+}
+
+void process_table::clear()
+{
+    for (auto& entry : _slots)
+    {
+        entry.pid = MISSING_PID;
+    }
+    _size = 0;
+}
+
+const process_table::node* process_table::find(pid_t pid) const
+{
+    const node& entry = _slots[slot(pid)];
+    return entry.pid == MISSING_PID ? nullptr : &entry;
+}
+
+pid_t process_table::parent(pid_t pid) const
+{
+    const node* entry = find(pid);
+    return entry ? entry->parent : MISSING_PID;
+}
+
+process_key process_table::key(pid_t pid) const
+{
+    const node* entry = find(pid);
+    return {pid, entry ? entry->start_ns : 0};
+}
+
+size_t process_table::children(pid_t pid, std::vector<pid_t>& out) const
+{
+    size_t count = 0;
+    for_each_child(pid, [&out, &count](const node& child) {
+        out.push_back(child.pid);
+        ++count;
+    });
+    return count;
+}
+
+size_t process_table::size() const
+{
+    return _size;
+}
+
+size_t process_table::capacity() const
+{
+    return _slots.size();
+}
+
+size_t process_table::home(pid_t pid) const
+{
+    // Fibonacci hashing, as consecutive pids are common
+    return (static_cast<uint64_t>(pid) * 11400714819323198485ull) >> _shift;
+}
+
+size_t process_table::slot(pid_t pid) const
+{
+    size_t index = home(pid);
+    while (_slots[index].pid != MISSING_PID && _slots[index].pid != pid)
+    {
+        index = (index + 1) & _mask;
+    }
+    return index;
+}
+
+process_table::node* process_table::lookup(pid_t pid)
+{
+    node& entry = _slots[slot(pid)];
+    return entry.pid == MISSING_PID ? nullptr : &entry;
+}
+
+void process_table::link(node& child)
+{
+    node* parent = lookup(child.parent);
+    if (!parent)
+    {
+        return;
+    }
+
+    child.next_sibling = parent->first_child;
+    if (parent->first_child != MISSING_PID)
+    {
+        lookup(parent->first_child)->prev_sibling = child.pid;
+    }
+    parent->first_child = child.pid;
+}
+
+void process_table::unlink(const node& child)
+{
+    if (child.prev_sibling != MISSING_PID)
+    {
+        lookup(child.prev_sibling)->next_sibling = child.next_sibling;
+    }
+    else if (node* parent = lookup(child.parent))
+    {
+        if (parent->first_child == child.pid)
+        {
+            parent->first_child = child.next_sibling;
+        }
+    }
+
+    if (child.next_sibling != MISSING_PID)
+    {
+        lookup(child.next_sibling)->prev_sibling = child.prev_sibling;
+    }
+}
+
+void process_table::remove(size_t index)
+{
+    // Backward shift deletion: Move later entries of the probe sequence
+    // into the hole, so that lookups never need tombstones
+    size_t next = index;
+    while (true)
+    {
+        next = (next + 1) & _mask;
+        if (_slots[next].pid == MISSING_PID)
+        {
+            break;
+        }
+
+        // Entries whose home is cyclically in (index, next] stay put
+        size_t wanted = home(_slots[next].pid);
+        bool stays    = index <= next ? index < wanted && wanted <= next
+                                      : index < wanted || wanted <= next;
+        if (!stays)
+        {
+            _slots[index] = _slots[next];
+            index         = next;
+        }
+    }
+
+    _slots[index].pid = MISSING_PID;
+    --_size;
+}
+
+void process_table::grow()
+{
+    std::vector<node> previous(_slots.size() * 2);
+    previous.swap(_slots);
+    _mask  = _slots.size() - 1;
+    _shift = 64 - index_bits(_slots.size());
+
+    for (const auto& entry : previous)
+    {
+        if (entry.pid != MISSING_PID)
+        {
+            _slots[slot(entry.pid)] = entry;
+        }
+    }
+}
+
+void process_table::relink()
+{
+    for (auto& entry : _slots)
+    {
+        entry.first_child  = MISSING_PID;
+        entry.next_sibling = MISSING_PID;
+        entry.prev_sibling = MISSING_PID;
+    }
+
+    for (auto& entry : _slots)
+    {
+        if (entry.pid != MISSING_PID)
+        {
+            link(entry);
+        }
+    }
+}
+
+void process_table::on_fork(const event& evt)
+{
+    const auto& child = evt.fork.child;
+    if (child.tid != child.pid)
+    {
+        return; // A new thread
+    }
+
+    // A fork during bootstrap() of a process it found already. Start times
+    // in /proc are truncated to clock ticks.
+    const node* existing = find(child.pid);
+    uint64_t start_ns    = evt.meta.timestamp_ns + impl::suspended_ns();
+    if (existing && evt.meta.timestamp_ns <= _scanned_until_ns &&
+        existing->start_ns <= start_ns + 2 * _tick_ns &&
+        start_ns <= existing->start_ns + 2 * _tick_ns)
+    {
+        return;
+    }
+
+    node& added = insert(child.pid, evt.fork.parent.pid, start_ns);
+
+    // The child inherits the name of its parent
+    const node* parent = find(added.parent);
+    if (parent)
+    {
+        memcpy(added.comm, parent->comm, sizeof(added.comm));
+    }
+}
+
+void process_table::on_exec(const event& evt)
+{
+    node* process = lookup(evt.exec.process.pid);
+    if (process)
+    {
+        ++process->exec_count;
+    }
+}
+
+void process_table::on_comm(const event& evt)
+{
+    const auto& ids = evt.comm.process;
+    if (ids.tid != ids.pid)
+    {
+        return; // Threads name themselves
+    }
+
+    node* process = lookup(ids.pid);
+    if (process)
+    {
+        memcpy(process->comm, evt.comm.comm, sizeof(process->comm));
+    }
+}
+
+void process_table::on_exit(const event& evt)
+{
+    const auto& ids = evt.exit.process;
+    if (ids.tid == ids.pid)
+    {
+        erase(ids.pid);
+    }
+}
+
+} // namespace rci
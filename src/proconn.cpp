@@ -1,12 +1,16 @@
-#include <string.h>
-#include <sys/socket.h>
-#include <sys/types.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
 #include <system_error>
 
 #include "rci/proconn.hpp"
-#include "rci/utils.hpp"
+#include "rci/rci_error.hpp"
 
 namespace rci {
 
@@ -14,314 +18,520 @@ using namespace impl;
 
 namespace {
 
-// Important note here:
-// ====================
-// This is the definition of 'struct proc_event' from kernel version 5.12.
-// Name is 'proconn_event' instead of 'proc_event' to prevent collisions.
-// We copy the struct here so that no matter which platform you use to
-// compile the proc connector, you can use it with all of the possible
-// kernel versions.
-// How? Instead of '#ifdef'-ing on the linux version to decide which members
-// are out there and which aren't, we compare the lenght of the incoming
-// message against the expected offsets of the members.
-// There is a caveat here. Because this is a union, the size of it is
-// always defined by the biggest possible member.
-// So, for example, on kernel 4.15, the parent information is not reported
-// for exit events, but the size is big enough to make us believe it is.
-// It's OK though becuase the kernel code always calls:
-// `memset(&ev->event_data, 0, sizeof(ev->event_data));`
-// So even if it's missing, we get 0, which we define as MISSING_PID.
-struct proconn_event {
-	enum what {
-		/* Use successive bits so the enums can be used to record
-		 * sets of events as well
-		 */
-		PROC_EVENT_NONE = 0x00000000,
-		PROC_EVENT_FORK = 0x00000001,
-		PROC_EVENT_EXEC = 0x00000002,
-		PROC_EVENT_UID  = 0x00000004,
-		PROC_EVENT_GID  = 0x00000040,
-		PROC_EVENT_SID  = 0x00000080,
-		PROC_EVENT_PTRACE = 0x00000100,
-		PROC_EVENT_COMM = 0x00000200,
-		/* "next" should be 0x00000400 */
-		/* "last" is the last process event: exit,
-		 * while "next to last" is coredumping event */
-		PROC_EVENT_COREDUMP = 0x40000000,
-		PROC_EVENT_EXIT = 0x80000000
-	} what;
-	__u32 cpu;
-	__u64 __attribute__((aligned(8))) timestamp_ns;
-		/* Number of nano seconds since system boot */
-	union { /* must be last field of proc_event struct */
-		struct {
-			__u32 err;
-		} ack;
-
-		struct fork_proc_event {
-			__kernel_pid_t parent_pid;
-			__kernel_pid_t parent_tgid;
-			__kernel_pid_t child_pid;
-			__kernel_pid_t child_tgid;
-		} fork;
-
-		struct exec_proc_event {
-			__kernel_pid_t process_pid;
-			__kernel_pid_t process_tgid;
-		} exec;
-
-		struct id_proc_event {
-			__kernel_pid_t process_pid;
-			__kernel_pid_t process_tgid;
-			union {
-				__u32 ruid; /* task uid */
-				__u32 rgid; /* task gid */
-			} r;
-			union {
-				__u32 euid;
-				__u32 egid;
-			} e;
-		} id;
-
-		struct sid_proc_event {
-			__kernel_pid_t process_pid;
-			__kernel_pid_t process_tgid;
-		} sid;
-
-		struct ptrace_proc_event {
-			__kernel_pid_t process_pid;
-			__kernel_pid_t process_tgid;
-			__kernel_pid_t tracer_pid;
-			__kernel_pid_t tracer_tgid;
-		} ptrace;
-
-		struct comm_proc_event {
-			__kernel_pid_t process_pid;
-			__kernel_pid_t process_tgid;
-			char           comm[16];
-		} comm;
-
-		struct coredump_proc_event {
-			__kernel_pid_t process_pid;
-			__kernel_pid_t process_tgid;
-			__kernel_pid_t parent_pid;
-			__kernel_pid_t parent_tgid;
-		} coredump;
-
-		struct exit_proc_event {
-			__kernel_pid_t process_pid;
-			__kernel_pid_t process_tgid;
-			__u32 exit_code, exit_signal;
-			__kernel_pid_t parent_pid;
-			__kernel_pid_t parent_tgid;
-		} exit;
-
-	} event_data;
-};
-
-static inline size_t proconn_event_header_size()
+// Mask of the event types that have a callback set, for both
+// event_callbacks and view_callbacks, which share member names
+template <typename Callbacks>
+static uint32_t callbacks_mask(const Callbacks& callbacks)
 {
-    proconn_event evt;
-    return sizeof(evt.what) +
-           sizeof(evt.cpu) +
-           sizeof(evt.timestamp_ns);
+    uint32_t mask = 0;
+    if (callbacks.fork)
+    {
+        mask |= proconn_event::PROC_EVENT_FORK;
+    }
+    if (callbacks.exec)
+    {
+        mask |= proconn_event::PROC_EVENT_EXEC;
+    }
+    if (callbacks.uid)
+    {
+        mask |= proconn_event::PROC_EVENT_UID;
+    }
+    if (callbacks.gid)
+    {
+        mask |= proconn_event::PROC_EVENT_GID;
+    }
+    if (callbacks.sid)
+    {
+        mask |= proconn_event::PROC_EVENT_SID;
+    }
+    if (callbacks.ptrace)
+    {
+        mask |= proconn_event::PROC_EVENT_PTRACE;
+    }
+    if (callbacks.comm)
+    {
+        mask |= proconn_event::PROC_EVENT_COMM;
+    }
+    if (callbacks.coredump)
+    {
+        mask |= proconn_event::PROC_EVENT_COREDUMP;
+    }
+    if (callbacks.exit)
+    {
+        mask |= proconn_event::PROC_EVENT_EXIT;
+    }
+    return mask;
 }
 
-} // anonymous namespace
-
-proconn::proconn(event_callbacks callbacks, size_t recv_buffer)
-    : _callbacks(callbacks), _recv_buffer(recv_buffer),
-      _bind_addr(build_bind_addr()), _kernel_addr(build_kernel_addr()),
-      _socket(socket_create())
+static bool has_views(const proconn::view_callbacks& views)
 {
-    // Do nothing
+    return views.fork || views.exec || views.uid || views.gid || views.sid ||
+           views.ptrace || views.comm || views.coredump || views.exit;
 }
 
-proconn::~proconn()
+static uint64_t monotonic_now()
 {
-    stop();
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
 }
 
-sockaddr_nl proconn::build_proconn_addr(pid_t tid)
+} // anonymous namespace
+
+static proconn::options build_options(size_t recv_buffer, size_t recv_batch)
 {
-    sockaddr_nl addr;
-    addr.nl_family = AF_NETLINK;
-    addr.nl_groups = CN_IDX_PROC;
-    addr.nl_pid    = tid;
-    return addr;
+    proconn::options opts;
+    opts.recv_buffer = recv_buffer;
+    opts.recv_batch  = recv_batch;
+    return opts;
 }
 
-sockaddr_nl proconn::build_bind_addr()
+proconn::proconn(event_callbacks callbacks, size_t recv_buffer,
+                 size_t recv_batch)
+    : proconn(callbacks, build_options(recv_buffer, recv_batch))
 {
-    // Build a proconn (netlink) address with the thread ID
-    return build_proconn_addr(utils::gettid());
+    // Do nothing
 }
 
-sockaddr_nl proconn::build_kernel_addr()
+proconn::proconn(event_callbacks callbacks, const options& opts)
+    : proconn(callbacks, view_callbacks(), opts)
 {
-    // Kernel proconn (netlink) addresses always use thread ID 0
-    return build_proconn_addr(0);
+    // Do nothing
 }
 
-int proconn::socket_create()
+proconn::proconn(event_callbacks callbacks, view_callbacks views,
+                 const options& opts)
+    : proconn_base(opts, event_mask(callbacks) | callbacks_mask(views)),
+      _callbacks(callbacks), _views(views), _mask(event_mask(callbacks)),
+      _newest_ns(0), _report_ns(opts.thread_report_ns), _next_report_ns(0),
+      _timer(-1), _timer_interval_ns(0)
 {
-    int sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
-    if (sock == -1)
+    if (_callbacks.any || _callbacks.batch)
     {
-        throw std::system_error(errno, std::system_category(),
-                                "Couldn't open socket");
+        _decoded.reserve(opts.recv_batch);
     }
 
-    int err = bind(sock, (struct sockaddr*)&_bind_addr, sizeof(_bind_addr));
-    if (err)
+    if (!opts.reorder_window_ns && !opts.thread_window_ns)
+    {
+        return;
+    }
+
+    if (has_views(views))
+    {
+        throw rci_error("Views can't be reordered or coalesced");
+    }
+
+    if (opts.reorder_window_ns)
+    {
+        _reorder.reset(new reorder_window(opts.reorder_window_ns,
+                                          opts.reorder_max_events));
+    }
+
+    if (opts.thread_window_ns)
+    {
+        _coalescer.reset(new thread_coalescer(opts.thread_window_ns,
+                                              opts.thread_max_held));
+    }
+
+    _timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_timer == -1)
     {
-        close(sock);
         throw std::system_error(errno, std::system_category(),
-                                "Couldn't bind socket");
+                                "Couldn't create timer");
     }
 
-    return sock;
+    watch(_timer);
+}
+
+proconn::~proconn()
+{
+    if (_timer >= 0)
+    {
+        close(_timer);
+    }
 }
 
-void proconn::socket_register()
+uint32_t proconn::event_mask(const event_callbacks& callbacks)
 {
-    static const enum proc_cn_mcast_op REGISTER_OP = PROC_CN_MCAST_LISTEN;
+    if (callbacks.any || callbacks.batch)
+    {
+        return ALL_EVENTS;
+    }
 
-    int err = socket_send_op(REGISTER_OP);
-    if (err)
+    uint32_t mask = callbacks_mask(callbacks);
+    if (callbacks.threads)
     {
-        throw std::system_error(-err, std::system_category(),
-                                "Couldn't register socket");
+        mask |= proconn_event::PROC_EVENT_FORK | proconn_event::PROC_EVENT_EXIT;
     }
+    return mask;
 }
 
-void proconn::socket_unregister()
+void proconn::deliver(const event_callbacks& callbacks, const event& evt)
 {
-    static const enum proc_cn_mcast_op UNREGISTER_OP = PROC_CN_MCAST_IGNORE;
+    switch (evt.type)
+    {
+        case event_type::fork:
+            if (callbacks.fork)
+            {
+                callbacks.fork({evt.meta, evt.fork.parent, evt.fork.child});
+            }
+            break;
+
+        case event_type::exec:
+            if (callbacks.exec)
+            {
+                callbacks.exec({evt.meta, evt.exec.process});
+            }
+            break;
+
+        case event_type::uid:
+            if (callbacks.uid)
+            {
+                callbacks.uid({evt.meta, evt.uid.process, evt.uid.ruid,
+                               evt.uid.euid});
+            }
+            break;
+
+        case event_type::gid:
+            if (callbacks.gid)
+            {
+                callbacks.gid({evt.meta, evt.gid.process, evt.gid.rgid,
+                               evt.gid.egid});
+            }
+            break;
+
+        case event_type::sid:
+            if (callbacks.sid)
+            {
+                callbacks.sid({evt.meta, evt.sid.process});
+            }
+            break;
+
+        case event_type::ptrace:
+            if (callbacks.ptrace)
+            {
+                callbacks.ptrace(
+                    {evt.meta, evt.ptrace.process, evt.ptrace.tracer});
+            }
+            break;
+
+        case event_type::comm:
+            if (callbacks.comm)
+            {
+                size_t size = strnlen(evt.comm.comm, sizeof(evt.comm.comm));
+                callbacks.comm({evt.meta, evt.comm.process,
+                                std::string(evt.comm.comm, size)});
+            }
+            break;
 
-    int err = socket_send_op(UNREGISTER_OP);
-    if (err)
+        case event_type::coredump:
+            if (callbacks.coredump)
+            {
+                callbacks.coredump(
+                    {evt.meta, evt.coredump.process, evt.coredump.parent});
+            }
+            break;
+
+        case event_type::exit:
+            if (callbacks.exit)
+            {
+                callbacks.exit({evt.meta, evt.exit.process,
+                                evt.exit.exit_code, evt.exit.exit_signal,
+                                evt.exit.parent});
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (callbacks.any)
     {
-        throw std::system_error(-err, std::system_category(),
-                                "Couldn't unregister socket");
+        callbacks.any(evt);
     }
 }
 
-int proconn::socket_send_op(enum proc_cn_mcast_op op)
+void proconn::run()
 {
-    void* data  = &op;
-    size_t size = sizeof(op);
+    receive_loop([this](const raw_event* events, size_t count) {
+        dispatch(events, count);
+    });
 
-    std::array<uint8_t, 1024> buffer;
-    buffer.fill(0);
+    if (_timer >= 0)
+    {
+        stage_flush();
+    }
+}
 
-    auto* nl_hdr = reinterpret_cast<struct nlmsghdr*>(buffer.data());
-    auto* nl_msg = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(nl_hdr));
+size_t proconn::process_pending(size_t max_events)
+{
+    size_t events =
+        receive_pending(max_events,
+                        [this](const raw_event* events, size_t count) {
+                            dispatch(events, count);
+                        });
+
+    if (_timer >= 0)
+    {
+        stage(nullptr, 0);
+    }
 
-    nl_hdr->nlmsg_len  = NLMSG_SPACE(NLMSG_LENGTH(sizeof(*nl_msg) + size));
-    nl_hdr->nlmsg_type = NLMSG_DONE;
-    nl_hdr->nlmsg_pid  = utils::gettid();
+    return events;
+}
 
-    nl_msg->id.idx = CN_IDX_PROC;
-    nl_msg->id.val = CN_VAL_PROC;
-    nl_msg->len    = size;
+reorder_window::stats proconn::reordering() const
+{
+    if (!_reorder)
+    {
+        return reorder_window::stats();
+    }
 
-    memcpy(nl_msg->data, data, size);
+    return _reorder->statistics();
+}
 
-    struct iovec iov = {};
-    iov.iov_base     = nl_hdr;
-    iov.iov_len      = nl_hdr->nlmsg_len;
+thread_coalescer::stats proconn::coalescing() const
+{
+    if (!_coalescer)
+    {
+        return thread_coalescer::stats();
+    }
 
-    struct msghdr msg = {};
-    msg.msg_name      = &_kernel_addr;
-    msg.msg_namelen   = sizeof(_kernel_addr);
-    msg.msg_iov       = &iov;
-    msg.msg_iovlen    = 1;
+    return _coalescer->statistics();
+}
 
-    ssize_t bytes = sendmsg(_socket, &msg, 0);
-    if (bytes < 0 || static_cast<size_t>(bytes) != nl_hdr->nlmsg_len)
+void proconn::on_lost(uint64_t overruns)
+{
+    if (_callbacks.lost)
     {
-        return -errno;
+        _callbacks.lost(overruns);
     }
+}
 
-    return 0;
+void proconn::on_gap(uint32_t cpu, uint64_t missed)
+{
+    if (_callbacks.gap)
+    {
+        _callbacks.gap(cpu, missed);
+    }
 }
 
-int proconn::socket_recv(sockaddr_nl& addr, std::vector<uint8_t>& buffer)
+void proconn::dispatch(const raw_event* events, size_t count)
 {
-    socklen_t addr_len = sizeof(addr);
+    if (_timer >= 0)
+    {
+        stage(events, count);
+        return;
+    }
+
+    bool decoding = _callbacks.any || _callbacks.batch;
+    if (decoding)
+    {
+        _decoded.resize(count);
+    }
 
-    auto* nl_hdr = reinterpret_cast<struct nlmsghdr*>(buffer.data());
+    // Each event reaches its own callbacks and then any, as when delivered
+    // out of the staging pipeline
+    size_t decoded = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        dispatch_event(events[i]);
 
-    ssize_t bytes = recvfrom(_socket, buffer.data(), buffer.size(), 0,
-                             reinterpret_cast<sockaddr*>(&addr), &addr_len);
-    if (bytes <= 0)
+        if (decoding && decode(events[i], _decoded[decoded]))
+        {
+            if (_callbacks.any)
+            {
+                _callbacks.any(_decoded[decoded]);
+            }
+            ++decoded;
+        }
+    }
+
+    if (_callbacks.batch && decoded)
     {
-        throw proconn_error("Receive message failed", bytes);
+        _callbacks.batch(_decoded.data(), decoded);
     }
+}
 
-    if (addr.nl_pid != _kernel_addr.nl_pid)
+void proconn::dispatch_decoded(const event* events, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
     {
-        throw proconn_error("Received message from unexpected source",
-                            addr.nl_pid);
+        deliver(_callbacks, events[i]);
     }
 
-    while (NLMSG_OK(nl_hdr, bytes))
+    if (_callbacks.batch && count)
     {
-        auto msg_type = nl_hdr->nlmsg_type;
-        if (msg_type == NLMSG_NOOP)
+        _callbacks.batch(events, count);
+    }
+}
+
+void proconn::stage(const raw_event* events, size_t count)
+{
+    _decoded.clear();
+
+    // Late events skip reordering, ahead of the ones released
+    event evt;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (events[i].data->what & _mask && decode(events[i], evt))
         {
-            continue;
+            _newest_ns = std::max(_newest_ns, evt.meta.timestamp_ns);
+            if (!_reorder || !_reorder->push(evt))
+            {
+                coalesce(evt);
+            }
         }
-        else if (msg_type == NLMSG_ERROR || msg_type == NLMSG_OVERRUN)
+    }
+
+    // An empty batch means the timer expired, or that the caller polls
+    uint64_t now_ns = _newest_ns;
+    if (count == 0)
+    {
+        uint64_t expirations;
+        while (read(_timer, &expirations, sizeof(expirations)) < 0 &&
+               errno == EINTR)
+            ;
+
+        now_ns = monotonic_now();
+    }
+
+    if (_reorder)
+    {
+        _reordered.clear();
+        _reorder->release(now_ns, _reordered);
+        for (const auto& released : _reordered)
         {
-            throw proconn_error("Received error", msg_type);
+            coalesce(released);
         }
+    }
 
-        auto* msg = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(nl_hdr));
-        dispatch_event(msg->data, msg->len);
+    if (_coalescer)
+    {
+        _coalescer->release(now_ns, _decoded);
+    }
+
+    dispatch_decoded(_decoded.data(), _decoded.size());
+
+    if (_coalescer)
+    {
+        report_threads(now_ns, false);
+    }
 
-        if (msg_type == NLMSG_DONE)
+    update_timer();
+}
+
+void proconn::stage_flush()
+{
+    _decoded.clear();
+
+    if (_reorder)
+    {
+        _reordered.clear();
+        _reorder->flush(_reordered);
+        for (const auto& released : _reordered)
         {
-            break;
+            coalesce(released);
         }
+    }
 
-        nl_hdr = NLMSG_NEXT(nl_hdr, bytes);
+    if (_coalescer)
+    {
+        _coalescer->flush(_decoded);
     }
 
-    return 0;
+    dispatch_decoded(_decoded.data(), _decoded.size());
+
+    if (_coalescer)
+    {
+        report_threads(0, true);
+    }
+
+    update_timer();
 }
 
-void proconn::run()
+void proconn::coalesce(const event& evt)
 {
-    socket_register();
+    if (_coalescer)
+    {
+        _coalescer->push(evt, _decoded);
+    }
+    else
+    {
+        _decoded.push_back(evt);
+    }
+}
 
-    sockaddr_nl addr = _kernel_addr;
-    std::vector<uint8_t> buffer(_recv_buffer);
-    while (!socket_recv(addr, buffer))
-        ;
+void proconn::report_threads(uint64_t now_ns, bool force)
+{
+    if (!force && now_ns < _next_report_ns)
+    {
+        return;
+    }
+
+    _next_report_ns = now_ns + _report_ns;
+
+    _churn.clear();
+    _coalescer->report(_churn);
+    if (_callbacks.threads)
+    {
+        for (const auto& churn : _churn)
+        {
+            _callbacks.threads(churn);
+        }
+    }
 }
 
-void proconn::stop()
+void proconn::update_timer()
 {
-    if (_socket < 0)
+    // Tick twice per window while events are held, and in time for the
+    // next report while thread counters are pending
+    uint64_t interval_ns = 0;
+    if (_reorder && _reorder->held())
+    {
+        interval_ns = _reorder->window() / 2;
+    }
+    if (_coalescer && (_coalescer->held() || _coalescer->pending()))
+    {
+        uint64_t coalescer_ns =
+            std::min<uint64_t>(_coalescer->window() / 2, _report_ns);
+        interval_ns = interval_ns ? std::min(interval_ns, coalescer_ns)
+                                  : coalescer_ns;
+    }
+    if (interval_ns)
     {
-        return; // Already stopped or not initialized
+        interval_ns = std::max<uint64_t>(interval_ns, 1000000);
     }
 
-    socket_unregister();
+    if (interval_ns == _timer_interval_ns)
+    {
+        return;
+    }
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec  = interval_ns / 1000000000;
+    spec.it_interval.tv_nsec = interval_ns % 1000000000;
+    spec.it_value            = spec.it_interval;
+
+    if (timerfd_settime(_timer, 0, &spec, NULL) == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't set timer");
+    }
 
-    close(_socket);
-    _socket = -1;
+    _timer_interval_ns = interval_ns;
 }
 
-void proconn::dispatch_event(const uint8_t *data, uint16_t len)
+void proconn::dispatch_event(const raw_event& event)
 {
-    (void)len;
-    auto evt = reinterpret_cast<const proconn_event*>(data);
+    auto evt = event.data;
+    auto len = event.len;
     switch (evt->what)
     {
         case proconn_event::PROC_EVENT_FORK:
+            if (_views.fork)
+            {
+                _views.fork(fork_event_view(evt, len));
+            }
             if (_callbacks.fork)
             {
                 _callbacks.fork({
@@ -336,6 +546,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proconn_event::PROC_EVENT_EXEC:
+            if (_views.exec)
+            {
+                _views.exec(exec_event_view(evt, len));
+            }
             if (_callbacks.exec)
             {
                 _callbacks.exec({
@@ -348,6 +562,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proc_event::PROC_EVENT_UID:
+            if (_views.uid)
+            {
+                _views.uid(uid_event_view(evt, len));
+            }
             if (_callbacks.uid)
             {
                 _callbacks.uid({
@@ -362,6 +580,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proconn_event::PROC_EVENT_GID:
+            if (_views.gid)
+            {
+                _views.gid(gid_event_view(evt, len));
+            }
             if (_callbacks.gid)
             {
                 _callbacks.gid({
@@ -375,6 +597,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proconn_event::PROC_EVENT_SID: // Task setting session IDs
+            if (_views.sid)
+            {
+                _views.sid(sid_event_view(evt, len));
+            }
             if (_callbacks.sid)
             {
                 _callbacks.sid({
@@ -386,6 +612,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proconn_event::PROC_EVENT_PTRACE:
+            if (_views.ptrace)
+            {
+                _views.ptrace(ptrace_event_view(evt, len));
+            }
             if (_callbacks.ptrace)
             {
                 _callbacks.ptrace({
@@ -399,6 +629,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proconn_event::PROC_EVENT_COMM:
+            if (_views.comm)
+            {
+                _views.comm(comm_event_view(evt, len));
+            }
             if (_callbacks.comm)
             {
                 _callbacks.comm({
@@ -411,6 +645,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proconn_event::PROC_EVENT_COREDUMP:
+            if (_views.coredump)
+            {
+                _views.coredump(coredump_event_view(evt, len));
+            }
             if (_callbacks.coredump)
             {
                 static const size_t header_size = proconn_event_header_size();
@@ -434,6 +672,10 @@ void proconn::dispatch_event(const uint8_t *data, uint16_t len)
             break;
 
         case proconn_event::PROC_EVENT_EXIT:
+            if (_views.exit)
+            {
+                _views.exit(exit_event_view(evt, len));
+            }
             if (_callbacks.exit)
             {
                 static const size_t header_size = proconn_event_header_size();
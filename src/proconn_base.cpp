@@ -0,0 +1,916 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <system_error>
+
+#include "rci/proconn_base.hpp"
+#include "rci/utils.hpp"
+
+namespace rci {
+namespace impl {
+
+namespace {
+
+// This is the definition of 'struct proc_input' from kernel version 6.6.
+// Registering with it, instead of a bare 'enum proc_cn_mcast_op', makes the
+// proc connector send only the event types set in 'event_type'.
+struct proconn_input {
+    enum proc_cn_mcast_op mcast_op;
+    __u32 event_type;
+};
+
+static inline bool native_filter_supported()
+{
+    static const unsigned NATIVE_FILTER_VERSION = (6 << 16) + (6 << 8);
+    return utils::kernel_version() >= NATIVE_FILTER_VERSION;
+}
+
+// Offset of the proc connector event in a netlink message
+static const uint32_t PROC_EVENT_OFFSET = NLMSG_HDRLEN + sizeof(struct cn_msg);
+
+#define PROC_EVENT_FIELD_OFFSET(field) \
+    (PROC_EVENT_OFFSET + offsetof(proconn_event, field))
+
+// Classic BPF program building blocks.
+// Note: Absolute loads convert from network byte order, so constants are
+// converted the same way for the comparisons to work on any architecture.
+static const sock_filter BPF_ACCEPT = BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+static const sock_filter BPF_DROP   = BPF_STMT(BPF_RET | BPF_K, 0);
+
+static inline sock_filter bpf_load(uint32_t offset)
+{
+    return BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset);
+}
+
+static inline sock_filter bpf_load_what()
+{
+    return bpf_load(PROC_EVENT_FIELD_OFFSET(what));
+}
+
+static inline sock_filter bpf_jeq(uint32_t value, uint8_t jt, uint8_t jf)
+{
+    return BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(value), jt, jf);
+}
+
+// Drops the message unless both fields hold the same value (5 instructions)
+static void bpf_require_equal(std::vector<sock_filter>& program,
+                              uint32_t offset1, uint32_t offset2)
+{
+    program.push_back(bpf_load(offset1));
+    program.push_back(BPF_STMT(BPF_MISC | BPF_TAX, 0));
+    program.push_back(bpf_load(offset2));
+    program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 1, 0));
+    program.push_back(BPF_DROP);
+}
+
+// Builds a classic BPF program for proc connector messages, accepting:
+// - Only the event types in mask, unless mask is 0
+// - Only process level fork/exit events, if processes_only is set
+// - Only the events of the processes in pids, unless it's empty
+static std::vector<sock_filter> build_filter(uint32_t mask,
+                                             bool processes_only,
+                                             const std::vector<pid_t>& pids)
+{
+    std::vector<sock_filter> program;
+
+    if (mask)
+    {
+        program.push_back(bpf_load_what());
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, htonl(mask),
+                                   1, 0));
+        program.push_back(BPF_DROP);
+    }
+
+    if (processes_only)
+    {
+        // Threads are tasks whose ID differs from their thread group ID
+        program.push_back(bpf_load_what());
+        program.push_back(bpf_jeq(proconn_event::PROC_EVENT_FORK, 0, 5));
+        bpf_require_equal(program,
+                          PROC_EVENT_FIELD_OFFSET(event_data.fork.child_pid),
+                          PROC_EVENT_FIELD_OFFSET(event_data.fork.child_tgid));
+
+        program.push_back(bpf_load_what());
+        program.push_back(bpf_jeq(proconn_event::PROC_EVENT_EXIT, 0, 5));
+        bpf_require_equal(
+            program, PROC_EVENT_FIELD_OFFSET(event_data.exit.process_pid),
+            PROC_EVENT_FIELD_OFFSET(event_data.exit.process_tgid));
+    }
+
+    if (!pids.empty())
+    {
+        // Forks belong to the forking process, and all other events start
+        // with the pid and tgid of the process they belong to
+        program.push_back(bpf_load_what());
+        program.push_back(bpf_jeq(proconn_event::PROC_EVENT_FORK, 0, 2));
+        program.push_back(
+            bpf_load(PROC_EVENT_FIELD_OFFSET(event_data.fork.parent_tgid)));
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JA, 1, 0, 0));
+        program.push_back(
+            bpf_load(PROC_EVENT_FIELD_OFFSET(event_data.exec.process_tgid)));
+
+        for (pid_t pid : pids)
+        {
+            program.push_back(bpf_jeq(pid, 0, 1));
+            program.push_back(BPF_ACCEPT);
+        }
+        program.push_back(BPF_DROP);
+    }
+    else
+    {
+        program.push_back(BPF_ACCEPT);
+    }
+
+    return program;
+}
+
+} // anonymous namespace
+
+static size_t cpu_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    return count > 0 ? count : 1;
+}
+
+constexpr uint32_t proconn_base::ALL_EVENTS;
+
+proconn_base::proconn_base(const options& opts, uint32_t callbacks_mask)
+    : _options(opts), _callbacks_mask(callbacks_mask),
+      _bind_addr(build_bind_addr()), _kernel_addr(build_kernel_addr()),
+      _socket(socket_create()),
+      _wakeup(-1), _watched(-1), _watched_ready(false),
+      _registered(false), _running(false), _stopping(false),
+      _socket_buffer_req(0), _filter_mode(filter_mode::user),
+      _overruns(0), _socket_buffer(0),
+      _track_gaps(true), _resync_sequences(false), _gaps(0),
+      _cpu_gaps(cpu_count())
+{
+    _cpu_next_seq.assign(_cpu_gaps.size(), 0);
+    _cpu_seen.assign(_cpu_gaps.size(), false);
+
+    _options.recv_batch = std::max<size_t>(_options.recv_batch, 1);
+    recv_pool_init();
+    _batch.reserve(_options.recv_batch);
+
+    try
+    {
+        _wakeup = wakeup_create();
+
+        if (_options.socket_buffer)
+        {
+            socket_set_buffer(_options.socket_buffer);
+        }
+        _socket_buffer = socket_get_buffer();
+
+        if (_options.kernel_filter)
+        {
+            _filter_mode = native_filter_supported() ? filter_mode::native
+                                                     : filter_mode::socket;
+
+            // Filtered events leave holes in the sequence numbers
+            _track_gaps = false;
+        }
+
+        if (_filter_mode == filter_mode::socket || _options.processes_only ||
+            !_options.pids.empty())
+        {
+            socket_attach_filter();
+        }
+    }
+    catch (...)
+    {
+        if (_wakeup >= 0)
+        {
+            close(_wakeup);
+        }
+        close(_socket);
+        throw;
+    }
+}
+
+proconn_base::~proconn_base()
+{
+    try
+    {
+        stop();
+    }
+    catch (...)
+    {
+        // Nothing sensible to do about a failed unregistration here
+    }
+
+    close(_wakeup);
+    close(_socket);
+}
+
+sockaddr_nl proconn_base::build_proconn_addr(pid_t tid)
+{
+    sockaddr_nl addr;
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid    = tid;
+    return addr;
+}
+
+sockaddr_nl proconn_base::build_bind_addr()
+{
+    // Build a proconn (netlink) address with the thread ID
+    return build_proconn_addr(utils::gettid());
+}
+
+sockaddr_nl proconn_base::build_kernel_addr()
+{
+    // Kernel proconn (netlink) addresses always use thread ID 0
+    return build_proconn_addr(0);
+}
+
+int proconn_base::socket_create()
+{
+    int sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
+    if (sock == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't open socket");
+    }
+
+    int err = bind(sock, (struct sockaddr*)&_bind_addr, sizeof(_bind_addr));
+    if (err)
+    {
+        close(sock);
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't bind socket");
+    }
+
+    return sock;
+}
+
+int proconn_base::wakeup_create()
+{
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd == -1)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't create wakeup event");
+    }
+
+    return fd;
+}
+
+void proconn_base::wakeup_signal()
+{
+    uint64_t value = 1;
+    while (write(_wakeup, &value, sizeof(value)) < 0 && errno == EINTR)
+        ;
+}
+
+void proconn_base::wakeup_clear()
+{
+    uint64_t value;
+    while (read(_wakeup, &value, sizeof(value)) < 0 && errno == EINTR)
+        ;
+}
+
+bool proconn_base::wait_readable()
+{
+    struct pollfd fds[3] = {};
+    fds[0].fd     = _socket;
+    fds[0].events = POLLIN;
+    fds[1].fd     = _wakeup;
+    fds[1].events = POLLIN;
+    fds[2].fd     = _watched;
+    fds[2].events = POLLIN;
+
+    nfds_t count = _watched >= 0 ? 3 : 2;
+    while (true)
+    {
+        int ready = poll(fds, count, -1);
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (ready < 0)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "Couldn't wait for events");
+        }
+
+        if (fds[1].revents)
+        {
+            wakeup_clear();
+            return false; // Woken up by stop()
+        }
+
+        _watched_ready = fds[2].revents != 0;
+
+        // The socket is either readable or in error, which the next
+        // receive call reports
+        return true;
+    }
+}
+
+void proconn_base::socket_register()
+{
+    static const enum proc_cn_mcast_op REGISTER_OP = PROC_CN_MCAST_LISTEN;
+
+    uint32_t mask = _filter_mode == filter_mode::native ? listen_mask() : 0;
+    int err       = socket_send_op(REGISTER_OP, mask);
+    if (err)
+    {
+        throw std::system_error(-err, std::system_category(),
+                                "Couldn't register socket");
+    }
+}
+
+void proconn_base::socket_unregister()
+{
+    static const enum proc_cn_mcast_op UNREGISTER_OP = PROC_CN_MCAST_IGNORE;
+
+    int err = socket_send_op(UNREGISTER_OP);
+    if (err)
+    {
+        throw std::system_error(-err, std::system_category(),
+                                "Couldn't unregister socket");
+    }
+}
+
+void proconn_base::socket_attach_filter()
+{
+    uint32_t mask = _filter_mode == filter_mode::socket ? listen_mask() : 0;
+    auto program  = build_filter(mask, _options.processes_only, _options.pids);
+
+    struct sock_fprog fprog = {};
+    fprog.len               = program.size();
+    fprog.filter            = program.data();
+
+    int err = setsockopt(_socket, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+                         sizeof(fprog));
+    if (err)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't attach socket filter");
+    }
+
+    // Filtered events leave holes in the sequence numbers
+    _track_gaps = false;
+}
+
+void proconn_base::filter_pids(const std::vector<pid_t>& pids)
+{
+    std::lock_guard<std::mutex> lock(_state_lock);
+    _options.pids = pids;
+
+    if (!pids.empty() || _filter_mode == filter_mode::socket ||
+        _options.processes_only)
+    {
+        socket_attach_filter();
+        return;
+    }
+
+    // Nothing left to filter, every event is received again
+    int unused = 0;
+    int err    = setsockopt(_socket, SOL_SOCKET, SO_DETACH_FILTER, &unused,
+                            sizeof(unused));
+    if (err && errno != ENOENT)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't detach socket filter");
+    }
+
+    if (_filter_mode == filter_mode::user)
+    {
+        // The sequences moved on while filtered, start tracking them anew
+        _resync_sequences = true;
+        _track_gaps       = true;
+    }
+}
+
+void proconn_base::socket_set_buffer(size_t size)
+{
+    int value = static_cast<int>(
+        std::min<size_t>(size, std::numeric_limits<int>::max()));
+
+    // SO_RCVBUFFORCE ignores net.core.rmem_max, but requires CAP_NET_ADMIN
+    int err = setsockopt(_socket, SOL_SOCKET, SO_RCVBUFFORCE, &value,
+                         sizeof(value));
+    if (err && errno == EPERM)
+    {
+        err = setsockopt(_socket, SOL_SOCKET, SO_RCVBUF, &value,
+                         sizeof(value));
+    }
+
+    if (err)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't set socket receive buffer");
+    }
+
+    _socket_buffer_req = value;
+}
+
+size_t proconn_base::socket_get_buffer()
+{
+    int value;
+    socklen_t len = sizeof(value);
+
+    // Note: The kernel reports twice the requested size, as it accounts for
+    // its own bookkeeping overhead as well
+    int err = getsockopt(_socket, SOL_SOCKET, SO_RCVBUF, &value, &len);
+    if (err)
+    {
+        throw std::system_error(errno, std::system_category(),
+                                "Couldn't get socket receive buffer");
+    }
+
+    return value;
+}
+
+void proconn_base::socket_grow_buffer()
+{
+    // The kernel might have rounded our last request up to its minimum
+    size_t current = std::max(_socket_buffer_req, _socket_buffer.load() / 2);
+    size_t target  = std::min(current * 2, _options.socket_buffer_max);
+    if (target <= current)
+    {
+        return; // Already at the cap
+    }
+
+    socket_set_buffer(target);
+    _socket_buffer = socket_get_buffer();
+}
+
+int proconn_base::socket_send_op(enum proc_cn_mcast_op op, uint32_t event_mask)
+{
+    proconn_input input;
+    input.mcast_op   = op;
+    input.event_type = event_mask;
+
+    // The kernel tells the two formats apart by their size
+    void* data  = &input;
+    size_t size = event_mask ? sizeof(input) : sizeof(op);
+
+    std::array<uint8_t, 1024> buffer;
+    buffer.fill(0);
+
+    auto* nl_hdr = reinterpret_cast<struct nlmsghdr*>(buffer.data());
+    auto* nl_msg = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(nl_hdr));
+
+    nl_hdr->nlmsg_len  = NLMSG_SPACE(NLMSG_LENGTH(sizeof(*nl_msg) + size));
+    nl_hdr->nlmsg_type = NLMSG_DONE;
+    nl_hdr->nlmsg_pid  = utils::gettid();
+
+    nl_msg->id.idx = CN_IDX_PROC;
+    nl_msg->id.val = CN_VAL_PROC;
+    nl_msg->len    = size;
+
+    memcpy(nl_msg->data, data, size);
+
+    struct iovec iov = {};
+    iov.iov_base     = nl_hdr;
+    iov.iov_len      = nl_hdr->nlmsg_len;
+
+    struct msghdr msg = {};
+    msg.msg_name      = &_kernel_addr;
+    msg.msg_namelen   = sizeof(_kernel_addr);
+    msg.msg_iov       = &iov;
+    msg.msg_iovlen    = 1;
+
+    ssize_t bytes = sendmsg(_socket, &msg, 0);
+    if (bytes < 0 || static_cast<size_t>(bytes) != nl_hdr->nlmsg_len)
+    {
+        return -errno;
+    }
+
+    return 0;
+}
+
+void proconn_base::recv_pool_init()
+{
+    // Keep every buffer in the pool aligned for the netlink headers
+    size_t batch = _options.recv_batch;
+    size_t slot  = NLMSG_ALIGN(_options.recv_buffer);
+
+    _recv_pool.assign(slot * batch, 0);
+    _recv_addrs.assign(batch, _kernel_addr);
+    _recv_iovs.resize(batch);
+    _recv_msgs.resize(batch);
+
+    for (size_t i = 0; i < batch; ++i)
+    {
+        _recv_iovs[i].iov_base = &_recv_pool[i * slot];
+        _recv_iovs[i].iov_len  = _options.recv_buffer;
+
+        _recv_msgs[i] = {};
+
+        msghdr& hdr     = _recv_msgs[i].msg_hdr;
+        hdr.msg_name    = &_recv_addrs[i];
+        hdr.msg_namelen = sizeof(_recv_addrs[i]);
+        hdr.msg_iov     = &_recv_iovs[i];
+        hdr.msg_iovlen  = 1;
+    }
+}
+
+bool proconn_base::socket_recv(size_t max_datagrams)
+{
+    size_t batch = std::min(max_datagrams, _options.recv_batch);
+    for (size_t i = 0; i < batch; ++i)
+    {
+        // The kernel overwrites the length with the actual address size
+        _recv_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_nl);
+    }
+
+    int count;
+    if (batch > 1)
+    {
+        // Take whatever is already queued, up to the size of the pool
+        count = recvmmsg(_socket, _recv_msgs.data(), batch, MSG_DONTWAIT,
+                         nullptr);
+        if (count < 0 && errno == ENOSYS)
+        {
+            // Kernels older than 2.6.33 don't support recvmmsg
+            _options.recv_batch = 1;
+            return socket_recv(max_datagrams);
+        }
+    }
+    else
+    {
+        ssize_t bytes = recvmsg(_socket, &_recv_msgs[0].msg_hdr, MSG_DONTWAIT);
+        if (bytes > 0)
+        {
+            _recv_msgs[0].msg_len = bytes;
+        }
+        count = bytes > 0 ? 1 : bytes;
+    }
+
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return false; // Nothing pending
+    }
+    else if (count < 0 && errno == ENOBUFS)
+    {
+        // The receive queue overflowed and the kernel dropped events.
+        // The socket itself is still perfectly usable.
+        handle_overrun(errno);
+        return true;
+    }
+    else if (count <= 0)
+    {
+        throw proconn_error("Receive message failed", count < 0 ? errno : 0);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        auto* data = static_cast<const uint8_t*>(_recv_iovs[i].iov_base);
+        process_message(_recv_addrs[i], data, _recv_msgs[i].msg_len);
+    }
+
+    return true;
+}
+
+void proconn_base::handle_overrun(int meta)
+{
+    if (_options.socket_buffer_max)
+    {
+        socket_grow_buffer();
+    }
+
+    if (_options.overrun != overrun_policy::report)
+    {
+        throw proconn_error("Receive queue overrun", meta);
+    }
+
+    on_lost(++_overruns);
+}
+
+void proconn_base::process_message(const sockaddr_nl& addr,
+                                   const uint8_t* data, size_t len)
+{
+    if (addr.nl_pid != _kernel_addr.nl_pid)
+    {
+        throw proconn_error("Received message from unexpected source",
+                            addr.nl_pid);
+    }
+
+    auto* nl_hdr  = reinterpret_cast<const struct nlmsghdr*>(data);
+    // NLMSG_OK compares against an int on some libc versions
+    int remaining = static_cast<int>(len);
+
+    for (; NLMSG_OK(nl_hdr, remaining); nl_hdr = NLMSG_NEXT(nl_hdr, remaining))
+    {
+        auto msg_type = nl_hdr->nlmsg_type;
+        if (msg_type == NLMSG_NOOP)
+        {
+            continue;
+        }
+        else if (msg_type == NLMSG_OVERRUN)
+        {
+            handle_overrun(msg_type);
+            continue;
+        }
+        else if (msg_type == NLMSG_ERROR)
+        {
+            throw proconn_error("Received error", msg_type);
+        }
+
+        auto* msg = reinterpret_cast<const struct cn_msg*>(NLMSG_DATA(nl_hdr));
+        if (_track_gaps)
+        {
+            if (_resync_sequences.load(std::memory_order_relaxed) &&
+                _resync_sequences.exchange(false))
+            {
+                _cpu_seen.assign(_cpu_seen.size(), false);
+            }
+            track_sequence(msg->seq, msg->data, msg->len);
+        }
+        _batch.push_back({reinterpret_cast<const proconn_event*>(msg->data),
+                          msg->len});
+
+        if (msg_type == NLMSG_DONE)
+        {
+            break;
+        }
+    }
+}
+
+bool proconn_base::receive(size_t max_datagrams)
+{
+    _batch.clear();
+    return socket_recv(max_datagrams);
+}
+
+bool proconn_base::run_begin()
+{
+    std::lock_guard<std::mutex> lock(_state_lock);
+    if (_stopping)
+    {
+        return false;
+    }
+
+    _running = true;
+    if (!_registered)
+    {
+        socket_register();
+        _registered = true;
+    }
+
+    return true;
+}
+
+void proconn_base::run_end(bool completed)
+{
+    std::lock_guard<std::mutex> lock(_state_lock);
+    _running = false;
+
+    // Failed runs stay registered, so that they can be resumed
+    if (completed && _registered)
+    {
+        _registered = false;
+        socket_unregister();
+    }
+}
+
+void proconn_base::start()
+{
+    std::lock_guard<std::mutex> lock(_state_lock);
+    if (_registered || _stopping)
+    {
+        return;
+    }
+
+    socket_register();
+    _registered = true;
+}
+
+int proconn_base::fd() const
+{
+    return _socket;
+}
+
+void proconn_base::watch(int fd)
+{
+    _watched = fd;
+}
+
+void proconn_base::stop()
+{
+    std::lock_guard<std::mutex> lock(_state_lock);
+    _stopping = true;
+
+    if (_running)
+    {
+        // run() unregisters on its way out
+        wakeup_signal();
+        return;
+    }
+
+    if (_registered)
+    {
+        _registered = false;
+        socket_unregister();
+    }
+}
+
+proconn_base::stats proconn_base::statistics() const
+{
+    stats snapshot;
+    snapshot.overruns      = _overruns.load(std::memory_order_relaxed);
+    snapshot.socket_buffer = _socket_buffer.load(std::memory_order_relaxed);
+    snapshot.gaps          = _gaps.load(std::memory_order_relaxed);
+
+    snapshot.cpu_gaps.reserve(_cpu_gaps.size());
+    for (const auto& gaps : _cpu_gaps)
+    {
+        snapshot.cpu_gaps.push_back(gaps.load(std::memory_order_relaxed));
+    }
+
+    return snapshot;
+}
+
+proconn_base::filter_mode proconn_base::filtering() const
+{
+    return _filter_mode;
+}
+
+bool proconn_base::decode(const raw_event& raw, event& out)
+{
+    static_assert(sizeof(out.comm.comm) == comm_view::CAPACITY,
+                  "Inline comm size mismatch");
+
+    auto evt = raw.data;
+    auto len = raw.len;
+
+    out      = event();
+    out.type = static_cast<event_type>(evt->what);
+    out.meta = {evt->cpu, evt->timestamp_ns};
+
+    switch (evt->what)
+    {
+        case proconn_event::PROC_EVENT_FORK:
+        {
+            fork_event_view view(evt, len);
+            out.fork.parent = view.parent();
+            out.fork.child  = view.child();
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_EXEC:
+        {
+            exec_event_view view(evt, len);
+            out.exec.process = view.process();
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_UID:
+        {
+            uid_event_view view(evt, len);
+            out.uid.process = view.process();
+            out.uid.ruid    = view.ruid();
+            out.uid.euid    = view.euid();
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_GID:
+        {
+            gid_event_view view(evt, len);
+            out.gid.process = view.process();
+            out.gid.rgid    = view.rgid();
+            out.gid.egid    = view.egid();
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_SID:
+        {
+            sid_event_view view(evt, len);
+            out.sid.process = view.process();
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_PTRACE:
+        {
+            ptrace_event_view view(evt, len);
+            out.ptrace.process = view.process();
+            out.ptrace.tracer  = view.tracer();
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_COMM:
+        {
+            comm_event_view view(evt, len);
+            out.comm.process = view.process();
+            memcpy(out.comm.comm, view.comm().data(), view.comm().size());
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_COREDUMP:
+        {
+            coredump_event_view view(evt, len);
+            out.coredump.process = view.process();
+            out.coredump.parent  = view.parent();
+            return true;
+        }
+
+        case proconn_event::PROC_EVENT_EXIT:
+        {
+            exit_event_view view(evt, len);
+            out.exit.process     = view.process();
+            out.exit.exit_code   = view.exit_code();
+            out.exit.exit_signal = view.exit_signal();
+            out.exit.parent      = view.parent();
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+uint32_t proconn_base::listen_mask() const
+{
+    return _options.event_mask ? _options.event_mask : _callbacks_mask;
+}
+
+void proconn_base::on_lost(uint64_t overruns)
+{
+    (void)overruns;
+}
+
+void proconn_base::on_gap(uint32_t cpu, uint64_t missed)
+{
+    (void)cpu;
+    (void)missed;
+}
+
+void proconn_base::track_sequence(uint32_t seq, const uint8_t* data, uint16_t len)
+{
+    static const size_t header_size = proconn_event_header_size();
+
+    if (len < header_size)
+    {
+        return;
+    }
+
+    auto evt     = reinterpret_cast<const proconn_event*>(data);
+    uint32_t cpu = evt->cpu;
+    if (cpu >= _cpu_next_seq.size())
+    {
+        // CPUs that are not part of the configuration can't be tracked
+        return;
+    }
+
+    if (evt->what == proconn_event::PROC_EVENT_NONE)
+    {
+        // Depending on the kernel version, acks either echo the sequence
+        // number of the request, or consume one from the CPU's sequence
+        if (_cpu_seen[cpu] && seq == _cpu_next_seq[cpu])
+        {
+            ++_cpu_next_seq[cpu];
+        }
+        return;
+    }
+
+    uint32_t expected  = _cpu_next_seq[cpu];
+    bool seen          = _cpu_seen[cpu];
+    _cpu_next_seq[cpu] = seq + 1;
+    _cpu_seen[cpu]     = true;
+
+    // Unsigned arithmetic handles wraparounds. Anything that looks like a
+    // step backwards is a restart of the numbering, not a gap.
+    uint32_t missed = seq - expected;
+    if (!seen || missed == 0 || missed > std::numeric_limits<int32_t>::max())
+    {
+        return;
+    }
+
+    _gaps += missed;
+    _cpu_gaps[cpu] += missed;
+
+    on_gap(cpu, missed);
+}
+
+} // namespace impl
+} // namespace rci
@@ -0,0 +1,235 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "rci/reorder_window.hpp"
+
+namespace rci {
+
+const uint32_t reorder_window::NONE;
+
+reorder_window::reorder_window(uint64_t window_ns, size_t max_events)
+    : _window_ns(window_ns), _max_events(std::max<size_t>(max_events, 1)),
+      _free(NONE), _newest(0), _released_until(0), _held(0), _released(0),
+      _late(0), _evicted(0)
+{
+    grow();
+
+    long cpus = std::max(sysconf(_SC_NPROCESSORS_CONF), 1L);
+    run empty = {NONE, NONE};
+    _runs.resize(cpus, empty);
+    _heads.reserve(cpus);
+}
+
+bool reorder_window::push(const event& evt)
+{
+    uint64_t timestamp = evt.meta.timestamp_ns;
+    if (timestamp < _released_until)
+    {
+        _late.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (evt.meta.cpu >= _runs.size())
+    {
+        run empty = {NONE, NONE};
+        _runs.resize(evt.meta.cpu + 1, empty);
+    }
+
+    uint32_t index = allocate(evt);
+    auto& events   = _runs[evt.meta.cpu];
+    if (events.oldest == NONE)
+    {
+        events.oldest = index;
+        events.newest = index;
+        _heads.emplace_back(timestamp, evt.meta.cpu);
+        std::push_heap(_heads.begin(), _heads.end(), std::greater<head>());
+    }
+    else
+    {
+        insert(events, index);
+    }
+
+    _newest = std::max(_newest, timestamp);
+    _held.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+size_t reorder_window::release(uint64_t now_ns, std::vector<event>& out)
+{
+    size_t released = 0;
+    while (!_heads.empty())
+    {
+        bool due   = _heads.front().first + _window_ns <= now_ns;
+        bool evict = held() > _max_events;
+        if (!due && !evict)
+        {
+            break;
+        }
+
+        if (!due)
+        {
+            _evicted.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        pop_oldest(out);
+        ++released;
+    }
+
+    return released;
+}
+
+size_t reorder_window::flush(std::vector<event>& out)
+{
+    size_t released = 0;
+    while (!_heads.empty())
+    {
+        pop_oldest(out);
+        ++released;
+    }
+
+    return released;
+}
+
+uint64_t reorder_window::newest() const
+{
+    return _newest;
+}
+
+uint64_t reorder_window::window() const
+{
+    return _window_ns;
+}
+
+size_t reorder_window::held() const
+{
+    return _held.load(std::memory_order_relaxed);
+}
+
+reorder_window::stats reorder_window::statistics() const
+{
+    stats snapshot;
+    snapshot.held     = _held.load(std::memory_order_relaxed);
+    snapshot.released = _released.load(std::memory_order_relaxed);
+    snapshot.late     = _late.load(std::memory_order_relaxed);
+    snapshot.evicted  = _evicted.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+uint32_t reorder_window::allocate(const event& evt)
+{
+    if (_free == NONE)
+    {
+        grow();
+    }
+
+    uint32_t index = _free;
+    _free          = _slots[index].next;
+
+    _slots[index].evt  = evt;
+    _slots[index].next = NONE;
+    return index;
+}
+
+// Doubles the slab, or allocates max_events slots at first
+void reorder_window::grow()
+{
+    size_t size  = _slots.size();
+    size_t added = std::max(size, _max_events);
+    _slots.resize(size + added);
+
+    for (size_t index = size + added; index > size; --index)
+    {
+        _slots[index - 1].next = _free;
+        _free                  = static_cast<uint32_t>(index - 1);
+    }
+}
+
+void reorder_window::insert(run& events, uint32_t index)
+{
+    const event& evt   = _slots[index].evt;
+    uint64_t timestamp = evt.meta.timestamp_ns;
+    if (_slots[events.newest].evt.meta.timestamp_ns <= timestamp)
+    {
+        _slots[events.newest].next = index;
+        events.newest              = index;
+        return;
+    }
+
+    // Rarely, a CPU reports events out of order. Keep the run sorted.
+    if (timestamp < _slots[events.oldest].evt.meta.timestamp_ns)
+    {
+        _slots[index].next = events.oldest;
+        events.oldest      = index;
+
+        // The run's entry in the heap has to follow its new oldest event
+        for (auto& entry : _heads)
+        {
+            if (entry.second == evt.meta.cpu)
+            {
+                entry.first = timestamp;
+            }
+        }
+        std::make_heap(_heads.begin(), _heads.end(), std::greater<head>());
+        return;
+    }
+
+    // After the last event that isn't newer. The newest event is, so the
+    // walk stops before the end of the run.
+    uint32_t before = events.oldest;
+    while (_slots[_slots[before].next].evt.meta.timestamp_ns <= timestamp)
+    {
+        before = _slots[before].next;
+    }
+
+    _slots[index].next  = _slots[before].next;
+    _slots[before].next = index;
+}
+
+void reorder_window::pop_oldest(std::vector<event>& out)
+{
+    std::pop_heap(_heads.begin(), _heads.end(), std::greater<head>());
+    uint32_t cpu = _heads.back().second;
+    _heads.pop_back();
+
+    auto& events   = _runs[cpu];
+    uint32_t index = events.oldest;
+    out.push_back(_slots[index].evt);
+
+    events.oldest      = _slots[index].next;
+    _slots[index].next = _free;
+    _free              = index;
+
+    _released_until = out.back().meta.timestamp_ns;
+    if (events.oldest != NONE)
+    {
+        _heads.emplace_back(_slots[events.oldest].evt.meta.timestamp_ns, cpu);
+        std::push_heap(_heads.begin(), _heads.end(), std::greater<head>());
+    }
+    else
+    {
+        events.newest = NONE;
+    }
+
+    _held.fetch_sub(1, std::memory_order_relaxed);
+    _released.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace rci
@@ -0,0 +1,246 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "rci/thread_coalescer.hpp"
+
+namespace rci {
+
+typedef impl::proconn_base::event_type event_type;
+
+const uint32_t thread_coalescer::NONE;
+
+thread_coalescer::thread_coalescer(uint64_t window_ns, size_t max_threads)
+    : _window_ns(window_ns), _max_threads(std::max<size_t>(max_threads, 1)),
+      _free(NONE), _held(0), _coalesced(0), _passed(0)
+{
+    grow();
+    _threads.reserve(_max_threads);
+}
+
+void thread_coalescer::push(const event& evt, std::vector<event>& out)
+{
+    if (evt.type == event_type::fork)
+    {
+        // A held thread that forks does something worth reporting
+        if (_threads.count(evt.fork.parent.tid))
+        {
+            release_thread(evt.fork.parent.tid, out);
+        }
+
+        if (evt.fork.child.tid != evt.fork.child.pid)
+        {
+            hold(evt, out);
+            return;
+        }
+
+        out.push_back(evt);
+        return;
+    }
+
+    // All payloads other than fork start with the ids of the process
+    const auto& process = evt.exec.process;
+
+    bool thread_exit =
+        evt.type == event_type::exit && process.tid != process.pid;
+    if (thread_exit)
+    {
+        auto& counters = _churn[process.pid];
+        counters.pid   = process.pid;
+        ++counters.exited;
+    }
+
+    auto iter = _threads.find(process.tid);
+    if (iter == _threads.end())
+    {
+        out.push_back(evt);
+        return;
+    }
+
+    if (thread_exit)
+    {
+        discard(iter->second);
+        _threads.erase(iter);
+        _held.fetch_sub(1, std::memory_order_relaxed);
+        _coalesced.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t index = allocate(evt);
+    auto& held     = iter->second;
+
+    _slots[held.last].next = index;
+    held.last              = index;
+}
+
+size_t thread_coalescer::release(uint64_t now_ns, std::vector<event>& out)
+{
+    size_t released = 0;
+    while (!_forks.empty() && _forks.front().first + _window_ns <= now_ns)
+    {
+        released += release_entry(_forks.front(), out);
+        _forks.pop_front();
+    }
+
+    return released;
+}
+
+size_t thread_coalescer::flush(std::vector<event>& out)
+{
+    size_t released = 0;
+    for (const auto& entry : _forks)
+    {
+        released += release_entry(entry, out);
+    }
+    _forks.clear();
+
+    return released;
+}
+
+size_t thread_coalescer::report(std::vector<churn>& out)
+{
+    for (const auto& entry : _churn)
+    {
+        out.push_back(entry.second);
+    }
+
+    size_t reported = _churn.size();
+    _churn.clear();
+    return reported;
+}
+
+uint64_t thread_coalescer::window() const
+{
+    return _window_ns;
+}
+
+size_t thread_coalescer::held() const
+{
+    return _held.load(std::memory_order_relaxed);
+}
+
+bool thread_coalescer::pending() const
+{
+    return !_churn.empty();
+}
+
+thread_coalescer::stats thread_coalescer::statistics() const
+{
+    stats snapshot;
+    snapshot.held      = _held.load(std::memory_order_relaxed);
+    snapshot.coalesced = _coalesced.load(std::memory_order_relaxed);
+    snapshot.passed    = _passed.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+uint32_t thread_coalescer::allocate(const event& evt)
+{
+    if (_free == NONE)
+    {
+        grow();
+    }
+
+    uint32_t index = _free;
+    _free          = _slots[index].next;
+
+    _slots[index].evt  = evt;
+    _slots[index].next = NONE;
+    return index;
+}
+
+// Doubles the slab, or allocates max_threads slots at first
+void thread_coalescer::grow()
+{
+    size_t size  = _slots.size();
+    size_t added = std::max(size, _max_threads);
+    _slots.resize(size + added);
+
+    for (size_t index = size + added; index > size; --index)
+    {
+        _slots[index - 1].next = _free;
+        _free                  = static_cast<uint32_t>(index - 1);
+    }
+}
+
+// Return the slots of a thread, linked already, to the free ones
+void thread_coalescer::discard(const thread& held)
+{
+    _slots[held.last].next = _free;
+    _free                  = held.first;
+}
+
+void thread_coalescer::hold(const event& evt, std::vector<event>& out)
+{
+    const auto& child = evt.fork.child;
+
+    auto& counters = _churn[child.pid];
+    counters.pid   = child.pid;
+    ++counters.spawned;
+
+    // The exit of a thread with the same id was missed
+    if (_threads.count(child.tid))
+    {
+        release_thread(child.tid, out);
+    }
+
+    // Make room by releasing the oldest threads early
+    while (_threads.size() >= _max_threads)
+    {
+        release_entry(_forks.front(), out);
+        _forks.pop_front();
+    }
+
+    uint32_t index = allocate(evt);
+    auto& held     = _threads[child.tid];
+    held.forked_ns = evt.meta.timestamp_ns;
+    held.first     = index;
+    held.last      = index;
+
+    _forks.emplace_back(evt.meta.timestamp_ns, child.tid);
+    _held.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool thread_coalescer::release_entry(const fork_entry& entry,
+                                     std::vector<event>& out)
+{
+    auto iter = _threads.find(entry.second);
+    if (iter == _threads.end() || iter->second.forked_ns != entry.first)
+    {
+        return false;
+    }
+
+    release_thread(entry.second, out);
+    return true;
+}
+
+void thread_coalescer::release_thread(pid_t tid, std::vector<event>& out)
+{
+    auto iter = _threads.find(tid);
+    uint32_t index = iter->second.first;
+    while (index != NONE)
+    {
+        out.push_back(_slots[index].evt);
+        index = _slots[index].next;
+    }
+
+    discard(iter->second);
+    _threads.erase(iter);
+    _held.fetch_sub(1, std::memory_order_relaxed);
+    _passed.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace rci
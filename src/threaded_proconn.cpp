@@ -0,0 +1,602 @@
+/*
+ *  Copyright 2020-present Daniel Trugman
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "rci/threaded_proconn.hpp"
+
+namespace rci {
+
+using namespace impl;
+
+threaded_proconn::shard::shard(size_t capacity)
+    : ring(capacity), backlog(0), above_high_water(false), max_depth(0),
+      published(0), full(0), high_water(0), blocked(0), dropped_newest(0),
+      dropped_oldest(0), coalesced(0)
+{
+    // Do nothing
+}
+
+threaded_proconn::threaded_proconn(event_callbacks callbacks)
+    : threaded_proconn(callbacks, options())
+{
+    // Do nothing
+}
+
+threaded_proconn::threaded_proconn(event_callbacks callbacks,
+                                   const options& opts)
+    : threaded_proconn(callbacks, opts, queue_options())
+{
+    // Do nothing
+}
+
+threaded_proconn::threaded_proconn(event_callbacks callbacks,
+                                   const options& opts,
+                                   const queue_options& queue)
+    : proconn_base(opts, proconn::event_mask(callbacks)),
+      _callbacks(callbacks), _mask(proconn::event_mask(callbacks)),
+      _queue_options(queue), _failed(false)
+{
+    size_t shards = std::max<size_t>(queue.workers, 1);
+    for (size_t i = 0; i < shards; ++i)
+    {
+        _shards.emplace_back(new shard(queue.capacity));
+        _shards.back()->staged.reserve(opts.recv_batch);
+        if (queue.policy == backpressure::coalesce)
+        {
+            _shards.back()->threads.reserve(opts.recv_batch);
+        }
+    }
+
+    if (queue.policy == backpressure::drop_oldest ||
+        queue.policy == backpressure::coalesce)
+    {
+        // Flush the events kept aside as soon as there is room for them
+        watch(_drained.fd());
+    }
+}
+
+threaded_proconn::~threaded_proconn()
+{
+    try
+    {
+        stop();
+    }
+    catch (...)
+    {
+        // Destructors must not throw
+    }
+
+    join();
+}
+
+void threaded_proconn::run()
+{
+    start_reader();
+
+    if (_queue_options.workers == 0)
+    {
+        work(*_shards.front());
+    }
+    else
+    {
+        for (auto& target : _shards)
+        {
+            if (!target->worker.joinable())
+            {
+                target->worker = std::thread(&threaded_proconn::work, this,
+                                             std::ref(*target));
+            }
+        }
+
+        while (!stopping())
+        {
+            _done.clear();
+            if (!stopping())
+            {
+                _done.wait();
+            }
+        }
+    }
+
+    join();
+    rethrow_error();
+}
+
+void threaded_proconn::start_reader()
+{
+    if (!_reader.joinable())
+    {
+        _reader = std::thread(&threaded_proconn::read, this);
+    }
+}
+
+int threaded_proconn::ready_fd() const
+{
+    return _shards.front()->ready.fd();
+}
+
+size_t threaded_proconn::consume(size_t max_events)
+{
+    if (_queue_options.workers != 0)
+    {
+        throw rci_error("Can't consume events dispatched by workers");
+    }
+
+    size_t consumed = consume(*_shards.front(), max_events);
+    if (_failed)
+    {
+        rethrow_error();
+    }
+
+    return consumed;
+}
+
+void threaded_proconn::stop()
+{
+    proconn_base::stop();
+
+    // Wake up the consumers, and the reader if it waits for space
+    _done.notify();
+    for (auto& target : _shards)
+    {
+        target->ready.notify();
+        target->space.notify();
+    }
+}
+
+size_t threaded_proconn::shards() const
+{
+    return _shards.size();
+}
+
+threaded_proconn::queue_stats threaded_proconn::queue_statistics() const
+{
+    queue_stats total = {};
+    for (size_t i = 0; i < _shards.size(); ++i)
+    {
+        auto snapshot = queue_statistics(i);
+        total.capacity += snapshot.capacity;
+        total.depth += snapshot.depth;
+        total.max_depth = std::max(total.max_depth, snapshot.max_depth);
+        total.published += snapshot.published;
+        total.full += snapshot.full;
+        total.high_water += snapshot.high_water;
+        total.blocked += snapshot.blocked;
+        total.dropped_newest += snapshot.dropped_newest;
+        total.dropped_oldest += snapshot.dropped_oldest;
+        total.coalesced += snapshot.coalesced;
+        total.backlog += snapshot.backlog;
+    }
+
+    return total;
+}
+
+threaded_proconn::queue_stats
+threaded_proconn::queue_statistics(size_t index) const
+{
+    const auto& source = *_shards.at(index);
+
+    queue_stats snapshot;
+    snapshot.capacity   = source.ring.capacity();
+    snapshot.depth      = source.ring.size();
+    snapshot.max_depth  = source.max_depth.load(std::memory_order_relaxed);
+    snapshot.published  = source.published.load(std::memory_order_relaxed);
+    snapshot.full       = source.full.load(std::memory_order_relaxed);
+    snapshot.high_water = source.high_water.load(std::memory_order_relaxed);
+
+    snapshot.blocked = source.blocked.load(std::memory_order_relaxed);
+    snapshot.dropped_newest =
+        source.dropped_newest.load(std::memory_order_relaxed);
+    snapshot.dropped_oldest =
+        source.dropped_oldest.load(std::memory_order_relaxed);
+    snapshot.coalesced = source.coalesced.load(std::memory_order_relaxed);
+    snapshot.backlog   = source.backlog.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void threaded_proconn::on_lost(uint64_t overruns)
+{
+    if (_callbacks.lost)
+    {
+        _callbacks.lost(overruns);
+    }
+}
+
+void threaded_proconn::on_gap(uint32_t cpu, uint64_t missed)
+{
+    if (_callbacks.gap)
+    {
+        _callbacks.gap(cpu, missed);
+    }
+}
+
+void threaded_proconn::read()
+{
+    try
+    {
+        receive_loop([this](const raw_event* events, size_t count) {
+            publish(events, count);
+        });
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+}
+
+void threaded_proconn::publish(const raw_event* events, size_t count)
+{
+    if (count == 0)
+    {
+        _drained.clear(); // Woken up to flush the events kept aside
+    }
+
+    event evt;
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Only queue the event types the callbacks receive
+        if (events[i].data->what & _mask && decode(events[i], evt))
+        {
+            _shards[route(evt)]->staged.push_back(evt);
+        }
+    }
+
+    for (auto& target : _shards)
+    {
+        if (!target->staged.empty())
+        {
+            publish(*target);
+        }
+    }
+}
+
+void threaded_proconn::publish(shard& target)
+{
+    auto& staged  = target.staged;
+    size_t pushed = target.ring.push(staged.data(), staged.size());
+    size_t kept   = 0;
+
+    if (pushed < staged.size())
+    {
+        target.full.fetch_add(1, std::memory_order_relaxed);
+
+        switch (_queue_options.policy)
+        {
+            case backpressure::block:
+                pushed = wait_for_space(target, pushed);
+                break;
+
+            case backpressure::drop_newest:
+                target.dropped_newest.fetch_add(staged.size() - pushed,
+                                                std::memory_order_relaxed);
+                break;
+
+            case backpressure::drop_oldest:
+            case backpressure::coalesce:
+                kept = staged.size() - pushed;
+                break;
+        }
+    }
+
+    target.published.fetch_add(pushed, std::memory_order_relaxed);
+    track_depth(target);
+
+    staged.erase(staged.begin(), staged.end() - kept);
+    if (kept)
+    {
+        if (_queue_options.policy == backpressure::coalesce)
+        {
+            coalesce(target);
+        }
+
+        // Keep at most a whole ring worth of events aside
+        size_t excess = staged.size() > target.ring.capacity()
+                            ? staged.size() - target.ring.capacity()
+                            : 0;
+        if (excess && _queue_options.policy == backpressure::drop_oldest)
+        {
+            staged.erase(staged.begin(), staged.begin() + excess);
+            target.dropped_oldest.fetch_add(excess,
+                                            std::memory_order_relaxed);
+        }
+        else if (excess)
+        {
+            pushed = wait_for_space(target, 0);
+            target.published.fetch_add(pushed, std::memory_order_relaxed);
+            staged.clear();
+        }
+    }
+    target.backlog.store(staged.size());
+
+    if (pushed)
+    {
+        target.ready.notify();
+    }
+}
+
+size_t threaded_proconn::wait_for_space(shard& target, size_t pushed)
+{
+    auto& staged = target.staged;
+    target.blocked.fetch_add(1, std::memory_order_relaxed);
+
+    // Block until the consumer makes room, leaving the socket queue to
+    // absorb the burst
+    while (true)
+    {
+        target.space.clear();
+        pushed += target.ring.push(staged.data() + pushed,
+                                   staged.size() - pushed);
+        if (pushed == staged.size() || stopping())
+        {
+            return pushed;
+        }
+
+        target.ready.notify();
+        target.space.wait();
+    }
+}
+
+void threaded_proconn::coalesce(shard& target)
+{
+    auto& staged = target.staged;
+
+    // The thread ids of events about a task, for forks those of the child.
+    // All payloads other than fork start with the ids of the process.
+    auto task = [](const event& evt) {
+        return evt.type == event_type::fork ? evt.fork.child
+                                            : evt.exec.process;
+    };
+
+    // Threads whose fork is kept aside, and those that exited since
+    auto& threads = target.threads;
+    threads.clear();
+    for (const auto& evt : staged)
+    {
+        auto ids = task(evt);
+        if (ids.tid == ids.pid)
+        {
+            continue; // Processes are never folded
+        }
+
+        if (evt.type == event_type::fork)
+        {
+            threads[ids.tid] = false;
+        }
+        else if (evt.type == event_type::exit)
+        {
+            auto iter = threads.find(ids.tid);
+            if (iter != threads.end())
+            {
+                iter->second = true;
+            }
+        }
+    }
+
+    auto folded = [&](const event& evt) {
+        auto iter = threads.find(task(evt).tid);
+        return iter != threads.end() && iter->second;
+    };
+
+    auto end = std::remove_if(staged.begin(), staged.end(), folded);
+    target.coalesced.fetch_add(staged.end() - end, std::memory_order_relaxed);
+    staged.erase(end, staged.end());
+}
+
+void threaded_proconn::discard_oldest(shard& source)
+{
+    // Make room for the events kept aside by the reader
+    size_t backlog = source.backlog.load();
+    size_t free    = source.ring.capacity() - source.ring.size();
+    if (backlog <= free)
+    {
+        return;
+    }
+
+    size_t discard     = backlog - free;
+    const event* first = nullptr;
+    while (discard)
+    {
+        size_t count = std::min(source.ring.peek(first), discard);
+        if (count == 0)
+        {
+            break;
+        }
+
+        source.ring.consume(count);
+        source.dropped_oldest.fetch_add(count, std::memory_order_relaxed);
+        discard -= count;
+    }
+}
+
+void threaded_proconn::track_depth(shard& target)
+{
+    size_t depth = target.ring.size();
+    if (depth > target.max_depth.load(std::memory_order_relaxed))
+    {
+        target.max_depth.store(depth, std::memory_order_relaxed);
+    }
+
+    size_t mark = _queue_options.high_water;
+    if (mark == 0)
+    {
+        return;
+    }
+
+    if (depth >= mark && !target.above_high_water)
+    {
+        target.high_water.fetch_add(1, std::memory_order_relaxed);
+    }
+    target.above_high_water = depth >= mark;
+}
+
+size_t threaded_proconn::route(const event& evt) const
+{
+    if (_shards.size() == 1)
+    {
+        return 0;
+    }
+
+    // A fork belongs to the child, so that it precedes the child's events.
+    // All other payloads start with the ids of the process.
+    pid_t pid = evt.type == event_type::fork ? evt.fork.child.pid
+                                             : evt.exec.process.pid;
+    return static_cast<uint32_t>(pid) % _shards.size();
+}
+
+void threaded_proconn::work(shard& source)
+{
+    try
+    {
+        while (!stopping())
+        {
+            source.ready.clear();
+            consume(source, std::numeric_limits<size_t>::max());
+
+            if (source.ring.empty() && !stopping())
+            {
+                source.ready.wait();
+            }
+        }
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+}
+
+size_t threaded_proconn::consume(shard& source, size_t max_events)
+{
+    source.ready.clear();
+
+    if (_queue_options.policy == backpressure::drop_oldest)
+    {
+        discard_oldest(source);
+    }
+
+    size_t consumed = 0;
+    const event* first = nullptr;
+    while (consumed < max_events && !stopping())
+    {
+        size_t count = source.ring.peek(first);
+        if (count == 0)
+        {
+            break;
+        }
+
+        count = std::min(count, max_events - consumed);
+        size_t delivered = 0;
+        try
+        {
+            deliver(first, count, delivered);
+        }
+        catch (...)
+        {
+            // Skip the failing event, the rest are kept for the next run
+            source.ring.consume(delivered);
+            source.space.notify();
+            if (!source.ring.empty())
+            {
+                source.ready.notify();
+            }
+            throw;
+        }
+
+        source.ring.consume(count);
+        source.space.notify();
+        consumed += count;
+    }
+
+    if (!source.ring.empty())
+    {
+        source.ready.notify(); // Stopped at max_events
+    }
+
+    if (source.backlog.load())
+    {
+        _drained.notify(); // There might be room for the events kept aside
+    }
+
+    return consumed;
+}
+
+void threaded_proconn::deliver(const event* events, size_t count,
+                               size_t& delivered)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        delivered = i + 1; // Counts the event even if a callback throws
+        proconn::deliver(_callbacks, events[i]);
+    }
+
+    if (_callbacks.batch)
+    {
+        _callbacks.batch(events, count);
+    }
+}
+
+void threaded_proconn::fail(std::exception_ptr error)
+{
+    {
+        std::lock_guard<std::mutex> lock(_error_lock);
+        if (!_error)
+        {
+            _error = error;
+        }
+    }
+    _failed = true;
+
+    try
+    {
+        stop();
+    }
+    catch (...)
+    {
+        // The first error is the one reported
+    }
+}
+
+void threaded_proconn::join()
+{
+    if (_reader.joinable())
+    {
+        _reader.join();
+    }
+
+    for (auto& target : _shards)
+    {
+        if (target->worker.joinable())
+        {
+            target->worker.join();
+        }
+    }
+}
+
+void threaded_proconn::rethrow_error()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(_error_lock);
+        std::swap(error, _error);
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace rci
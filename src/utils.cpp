@@ -14,7 +14,9 @@
  *  limitations under the License.
  */
 
+#include <stdio.h>
 #include <sys/types.h>
+#include <sys/utsname.h>
 #include <unistd.h>
 #include <syscall.h>
 
@@ -29,6 +31,24 @@ pid_t gettid()
     return syscall(SYS_gettid);
 }
 
+unsigned kernel_version()
+{
+    struct utsname name;
+    if (uname(&name))
+    {
+        return 0;
+    }
+
+    unsigned major = 0, minor = 0, patch = 0;
+    if (sscanf(name.release, "%u.%u.%u", &major, &minor, &patch) < 2)
+    {
+        return 0;
+    }
+
+    // Same encoding as KERNEL_VERSION, where the patch level saturates
+    return (major << 16) + (minor << 8) + (patch > 255 ? 255 : patch);
+}
+
 } // namespace utils
 } // namespace impl
 } // namespace rci
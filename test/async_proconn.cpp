@@ -0,0 +1,164 @@
+// Built as C++20 when the compiler supports it, and skipped otherwise
+#if __cplusplus >= 202002L
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "catch.hpp"
+#include "pump.hpp"
+
+#include "rci/async_proconn.hpp"
+
+namespace {
+
+// Runs eagerly, and is never awaited
+struct detached
+{
+    struct promise_type
+    {
+        detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+detached collect_exits(rci::async_proconn& apc, std::set<pid_t>& exited,
+                       bool& done)
+{
+    auto sub = apc.subscribe(
+        static_cast<uint32_t>(rci::proconn::event_type::exit));
+
+    while (auto evt = co_await sub.next())
+    {
+        REQUIRE(evt->type == rci::proconn::event_type::exit);
+        exited.insert(evt->exit.process.tid);
+    }
+
+    done = true;
+}
+
+// Suspends at the end, so a coroutine still waiting can be destroyed too
+struct owned
+{
+    struct promise_type
+    {
+        owned get_return_object()
+        {
+            return owned(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit owned(std::coroutine_handle<> handle) : handle(handle) {}
+    owned(owned&& other) : handle(std::exchange(other.handle, nullptr)) {}
+    ~owned()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<> handle;
+};
+
+// Awaits the subscription as it is when called, even if later replaced
+owned count_events(rci::async_proconn::subscription& sub, size_t& count)
+{
+    for (;;)
+    {
+        auto evt = co_await sub.next();
+        if (!evt)
+        {
+            break;
+        }
+        ++count;
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE("Async proconn", "[proconn]")
+{
+    static const size_t CONSUMERS = 1000;
+    static const size_t CHILDREN  = 4;
+
+    rci::async_proconn apc;
+
+    std::vector<std::set<pid_t>> exited(CONSUMERS);
+    std::deque<bool> done(CONSUMERS, false);
+    for (size_t i = 0; i < CONSUMERS; ++i)
+    {
+        collect_exits(apc, exited[i], done[i]);
+    }
+
+    apc.start();
+
+    std::set<pid_t> pids;
+    for (size_t i = 0; i < CHILDREN; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            _exit(0);
+        }
+        pids.insert(pid);
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+    }
+
+    auto all_exited = [&]() {
+        for (const auto& seen : exited)
+        {
+            for (auto pid : pids)
+            {
+                if (!seen.count(pid))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    pump_until(apc, all_exited);
+
+    REQUIRE(all_exited());
+
+    // Replaced subscriptions stop receiving events, while the others go on
+    size_t replaced_events = 0;
+    auto replaced          = apc.subscribe();
+    auto waiting           = count_events(replaced, replaced_events);
+    auto live              = apc.subscribe();
+    replaced               = apc.subscribe();
+
+    std::thread([] {}).join();
+
+    pump_until(apc, [&]() { return live.pending() > 0; });
+
+    REQUIRE(live.pending() > 0);
+    REQUIRE(replaced.pending() == live.pending());
+    REQUIRE(replaced_events == 0);
+
+    apc.close();
+    for (auto finished : done)
+    {
+        REQUIRE(finished);
+    }
+}
+
+#endif
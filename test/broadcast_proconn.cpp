@@ -0,0 +1,203 @@
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "rci/broadcast_proconn.hpp"
+#include "rci/broadcast_ring.hpp"
+
+TEST_CASE("Broadcast ring", "[broadcast_ring]")
+{
+    rci::broadcast_ring<uint64_t> ring(8);
+
+    std::vector<uint64_t> items(20);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        items[i] = i;
+    }
+
+    SECTION("Blocking consumers hold back the producer")
+    {
+        auto first  = ring.add_consumer(rci::broadcast_policy::block);
+        auto second = ring.add_consumer(rci::broadcast_policy::block);
+
+        REQUIRE(ring.push(items.data(), 10) == 8);
+        REQUIRE(ring.push(items.data(), 1) == 0);
+
+        const uint64_t* read = nullptr;
+        REQUIRE(ring.peek(first, read) == 8);
+        REQUIRE(read[7] == 7);
+        ring.consume(first, 4);
+        REQUIRE(ring.push(items.data(), 1) == 0);
+
+        ring.consume(second, 4);
+        REQUIRE(ring.push(items.data() + 8, 4) == 4);
+
+        REQUIRE(ring.peek(first, read) == 4); // Up to the end of the ring
+        REQUIRE(read[0] == 4);
+        REQUIRE(ring.lag(first) == 8);
+        REQUIRE(ring.lost(first) == 0);
+    }
+
+    SECTION("Overwriting consumers lose their oldest items")
+    {
+        auto lossy = ring.add_consumer(rci::broadcast_policy::overwrite);
+
+        for (size_t i = 0; i < items.size(); i += 5)
+        {
+            REQUIRE(ring.push(items.data() + i, 5) == 5);
+        }
+
+        uint64_t read[16];
+        REQUIRE(ring.read(lossy, read, 16) == 8);
+        REQUIRE(read[0] == 12);
+        REQUIRE(read[7] == 19);
+        REQUIRE(ring.lost(lossy) == 12);
+        REQUIRE(ring.lag(lossy) == 0);
+    }
+
+    SECTION("Consumer threads read everything in order")
+    {
+        static const uint64_t COUNT = 100000;
+        static const int CONSUMERS  = 4;
+
+        for (int i = 0; i < CONSUMERS; ++i)
+        {
+            ring.add_consumer(rci::broadcast_policy::block);
+        }
+
+        std::atomic<int> ordered(0);
+        std::vector<std::thread> consumers;
+        for (int i = 0; i < CONSUMERS; ++i)
+        {
+            consumers.emplace_back([&ring, &ordered, i]() {
+                bool in_order = true;
+                for (uint64_t expected = 0; expected < COUNT;)
+                {
+                    const uint64_t* read = nullptr;
+                    size_t count         = ring.peek(i, read);
+                    for (size_t j = 0; j < count; ++j, ++expected)
+                    {
+                        in_order = in_order && read[j] == expected;
+                    }
+                    ring.consume(i, count);
+
+                    if (count == 0)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                ordered += in_order;
+            });
+        }
+
+        for (uint64_t i = 0; i < COUNT;)
+        {
+            if (ring.push(&i, 1))
+            {
+                ++i;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        for (auto& consumer : consumers)
+        {
+            consumer.join();
+        }
+        REQUIRE(ordered == CONSUMERS);
+    }
+}
+
+TEST_CASE("Broadcast proconn", "[proconn]")
+{
+    static const size_t CHILDREN = 32;
+
+    std::mutex lock;
+    std::vector<std::set<pid_t>> exited(3);
+    std::atomic<bool> released(false);
+
+    auto collect = [&](size_t index) {
+        rci::broadcast_proconn::consumer config;
+        config.callbacks.exit = [&, index](rci::proconn::exit_event evt) {
+            std::lock_guard<std::mutex> guard(lock);
+            exited[index].insert(evt.process.tid);
+        };
+        return config;
+    };
+
+    // Two consumers that see everything, and a stuck one that may lose
+    std::vector<rci::broadcast_proconn::consumer> consumers;
+    consumers.push_back(collect(0));
+    consumers.push_back(collect(1));
+    consumers.push_back(collect(2));
+    consumers[2].policy         = rci::broadcast_policy::overwrite;
+    consumers[2].callbacks.exit = [&](rci::proconn::exit_event evt) {
+        while (!released)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        exited[2].insert(evt.process.tid);
+    };
+
+    rci::broadcast_proconn pc(consumers, rci::proconn::options(), 8);
+    std::thread runner([&pc]() { pc.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::set<pid_t> pids;
+    for (size_t i = 0; i < CHILDREN; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            _exit(0);
+        }
+        pids.insert(pid);
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+    }
+
+    // The stuck consumer doesn't hold back the others
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto pid : pids)
+        {
+            REQUIRE(exited[0].count(pid) == 1);
+            REQUIRE(exited[1].count(pid) == 1);
+        }
+    }
+
+    released = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    pc.stop();
+    runner.join();
+
+    auto ring = pc.ring_statistics();
+    REQUIRE(ring.capacity == 8);
+    REQUIRE(ring.published >= CHILDREN);
+
+    auto first = pc.consumer_statistics(0);
+    REQUIRE(first.delivered == ring.published);
+    REQUIRE(first.lost == 0);
+
+    auto stuck = pc.consumer_statistics(2);
+    REQUIRE(stuck.lost > 0);
+    REQUIRE(stuck.delivered + stuck.lost == ring.published);
+    REQUIRE(exited[2].size() < CHILDREN);
+}
@@ -0,0 +1,130 @@
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <csignal>
+
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "pump.hpp"
+
+#include "rci/exec_enricher.hpp"
+
+TEST_CASE("Exec enricher", "[proconn]")
+{
+    pid_t pid = 0;
+
+    bool enriched = false;
+    std::string exe;
+    std::string cwd;
+    std::vector<std::string> args;
+
+    rci::exec_enricher enricher([&](const rci::exec_enricher::exec_info& info) {
+        if (info.process.pid == pid && !info.gone)
+        {
+            enriched = true;
+            exe      = info.exe.str();
+            cwd      = info.cwd.str();
+            args     = info.args();
+        }
+    });
+
+    rci::proconn::event_callbacks callbacks;
+    enricher.attach(callbacks);
+
+    rci::proconn pc(callbacks, rci::proconn::options());
+    pc.start();
+
+    pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        if (chdir("/tmp") == 0)
+        {
+            execl("/bin/sleep", "sleep", "10", (char*)NULL);
+        }
+        _exit(1);
+    }
+
+    pump_until(pc, [&] { return enriched; });
+
+    kill(pid, SIGKILL);
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    REQUIRE(enriched);
+    REQUIRE(exe.find("sleep") != std::string::npos);
+    REQUIRE(cwd == "/tmp");
+    REQUIRE(args == std::vector<std::string>({"sleep", "10"}));
+
+    auto stats = enricher.statistics();
+    REQUIRE(stats.execs >= 1);
+    REQUIRE(stats.unpinned == 0);
+}
+
+TEST_CASE("Exec enricher of exited processes", "[exec_enricher]")
+{
+    bool gone = false;
+
+    rci::exec_enricher::options opts;
+    opts.cmdline_max = 4;
+
+    rci::exec_enricher enricher(
+        [&](const rci::exec_enricher::exec_info& info) {
+            gone = info.gone && info.exe.size == 0;
+        },
+        opts);
+
+    // A zombie, that was never reaped
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(0);
+    }
+    siginfo_t status;
+    REQUIRE(waitid(P_PID, pid, &status, WEXITED | WNOWAIT) == 0);
+
+    enricher.enrich({0, 0}, {pid, pid});
+    REQUIRE(gone);
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    enricher.enrich({0, 0}, {99999999, 99999999});
+    REQUIRE(gone);
+    REQUIRE(enricher.statistics().gone == 2);
+
+    // Arguments cut at the size of the buffer
+    enricher.enrich({0, 0}, {getpid(), getpid()});
+    REQUIRE_FALSE(gone);
+    REQUIRE(enricher.statistics().truncated == 1);
+}
+
+TEST_CASE("Exec enricher out of descriptors", "[exec_enricher]")
+{
+    bool gone = true;
+
+    rci::exec_enricher enricher(
+        [&](const rci::exec_enricher::exec_info& info) { gone = info.gone; });
+
+    // No descriptor left for pidfd_open, nor for the cmdline
+    int fd = dup(0);
+    REQUIRE(fd >= 0);
+    close(fd);
+
+    struct rlimit limit;
+    REQUIRE(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    struct rlimit lowered = limit;
+    lowered.rlim_cur      = fd;
+    REQUIRE(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+
+    enricher.enrich({0, 0}, {getpid(), getpid()});
+
+    REQUIRE(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+
+    REQUIRE_FALSE(gone);
+    auto stats = enricher.statistics();
+    REQUIRE(stats.gone == 0);
+    REQUIRE(stats.unpinned == 1);
+}
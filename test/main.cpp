@@ -15,4 +15,5 @@
  */
 
 #define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_NO_POSIX_SIGNALS // MINSIGSTKSZ is not constexpr since glibc 2.34
 #include "catch.hpp"
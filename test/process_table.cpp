@@ -0,0 +1,597 @@
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "catch.hpp"
+#include "pump.hpp"
+
+#include "rci/process_resync.hpp"
+#include "rci/process_table.hpp"
+
+typedef rci::process_table::event event;
+typedef rci::proconn::event_type event_type;
+
+// The events the process table and resync chain into
+static const uint32_t TABLE_EVENTS =
+    static_cast<uint32_t>(event_type::fork) |
+    static_cast<uint32_t>(event_type::exec) |
+    static_cast<uint32_t>(event_type::comm) |
+    static_cast<uint32_t>(event_type::exit);
+
+static event make_fork(pid_t parent, pid_t child, pid_t child_tgid,
+                       uint64_t timestamp)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type              = event_type::fork;
+    evt.meta.timestamp_ns = timestamp;
+    evt.fork.parent       = {parent, parent};
+    evt.fork.child        = {child, child_tgid};
+    return evt;
+}
+
+static event make_task_event(event_type type, pid_t tid, pid_t pid)
+{
+    event evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.type         = type;
+    evt.exec.process = {tid, pid}; // Shared by all payloads but fork
+    return evt;
+}
+
+// Write a fake /proc/<pid>/stat under root
+static void write_stat(const std::string& root, pid_t pid, const char* stat)
+{
+    std::string dir = root + "/" + std::to_string(pid);
+    mkdir(dir.c_str(), 0700);
+
+    FILE* file = fopen((dir + "/stat").c_str(), "w");
+    REQUIRE(file != nullptr);
+    fputs(stat, file);
+    fclose(file);
+}
+
+static void write_stat(const std::string& root, pid_t pid, pid_t parent,
+                       uint64_t start_ticks)
+{
+    std::string stat = std::to_string(pid) + " (test) S " +
+                       std::to_string(parent) +
+                       " 0 0 0 -1 0 0 0 0 0 0 0 0 0 20 0 1 0 " +
+                       std::to_string(start_ticks) + " 0 0\n";
+    write_stat(root, pid, stat.c_str());
+}
+
+TEST_CASE("Process table", "[process_table]")
+{
+    rci::process_table table(4);
+
+    SECTION("Forks build a tree of processes")
+    {
+        table.insert(1, 0, 0);
+        table.apply(make_fork(1, 100, 100, 10));
+        table.apply(make_fork(1, 200, 200, 20));
+        table.apply(make_fork(100, 101, 101, 30));
+        table.apply(make_fork(100, 102, 100, 40)); // A thread
+
+        REQUIRE(table.size() == 4);
+        REQUIRE(table.parent(101) == 100);
+        REQUIRE(table.parent(100) == 1);
+        REQUIRE(table.find(102) == nullptr);
+        REQUIRE(table.find(200)->start_ns == 20 + rci::impl::suspended_ns());
+
+        std::vector<pid_t> children;
+        REQUIRE(table.children(1, children) == 2);
+        REQUIRE(children == std::vector<pid_t>({200, 100}));
+
+        SECTION("Exec and comm update the process")
+        {
+            event comm = make_task_event(event_type::comm, 100, 100);
+            strcpy(comm.comm.comm, "worker");
+            table.apply(comm);
+            table.apply(make_task_event(event_type::exec, 100, 100));
+
+            REQUIRE(strcmp(table.find(100)->comm, "worker") == 0);
+            REQUIRE(table.find(100)->exec_count == 1);
+
+            // Children inherit the name of their parent
+            table.apply(make_fork(100, 103, 103, 50));
+            REQUIRE(strcmp(table.find(103)->comm, "worker") == 0);
+        }
+
+        SECTION("Exits remove the process and orphan its children")
+        {
+            table.apply(make_task_event(event_type::exit, 102, 100));
+            REQUIRE(table.find(100) != nullptr);
+
+            table.apply(make_task_event(event_type::exit, 100, 100));
+            REQUIRE(table.find(100) == nullptr);
+            REQUIRE(table.parent(101) == rci::process_table::MISSING_PID);
+
+            children.clear();
+            REQUIRE(table.children(1, children) == 1);
+            REQUIRE(children[0] == 200);
+        }
+    }
+
+    SECTION("Lookups survive growing and erasing")
+    {
+        std::vector<pid_t> pids(20000);
+        for (size_t i = 0; i < pids.size(); ++i)
+        {
+            pids[i] = 1 + i * 7;
+        }
+        std::shuffle(pids.begin(), pids.end(), std::mt19937(1));
+
+        for (auto pid : pids)
+        {
+            table.insert(pid, 1, pid);
+        }
+        REQUIRE(table.size() == pids.size());
+        REQUIRE(table.capacity() >= pids.size() * 2);
+
+        std::set<pid_t> erased(pids.begin(), pids.begin() + pids.size() / 2);
+        for (auto pid : erased)
+        {
+            REQUIRE(table.erase(pid));
+        }
+        REQUIRE_FALSE(table.erase(erased.count(1) ? 1 : 2));
+
+        bool found = true;
+        for (auto pid : pids)
+        {
+            const auto* entry = table.find(pid);
+            found = found && (erased.count(pid) ? entry == nullptr
+                                                : entry && entry->pid == pid);
+        }
+        REQUIRE(found);
+        REQUIRE(table.size() == pids.size() - erased.size());
+    }
+}
+
+TEST_CASE("Process table from proconn", "[proconn]")
+{
+    rci::process_table table;
+    table.insert(getpid(), getppid(), 0);
+
+    bool exited     = false;
+    bool was_listed = false;
+
+    pid_t pid = 0;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.exit = [&](rci::proconn::exit_event evt) {
+        if (evt.process.tid == pid)
+        {
+            // Still listed while its exit callback is called
+            was_listed = table.parent(pid) == getpid();
+            exited     = true;
+        }
+    };
+    table.attach(callbacks);
+
+    rci::proconn pc(callbacks, rci::proconn::options());
+    pc.start();
+
+    pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(0);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    pump_until(pc, [&] { return exited; });
+
+    REQUIRE(exited);
+    REQUIRE(was_listed);
+    REQUIRE(table.find(pid) == nullptr);
+    REQUIRE(table.find(getpid()) != nullptr);
+}
+
+TEST_CASE("Process table bootstrap", "[process_table]")
+{
+    rci::process_table table(4);
+
+    SECTION("Parses names with spaces and parentheses")
+    {
+        char root[] = "/tmp/rci-proc-XXXXXX";
+        REQUIRE(mkdtemp(root) != nullptr);
+
+        // Children listed before their parents
+        write_stat(root, 30, "30 (a) b) (c) S 20 30 30 0 -1 4194560 0 0 0 0 "
+                             "0 0 0 0 20 0 1 0 300 0 0\n");
+        write_stat(root, 20, "20 (sh) S 1 20 20 0 -1 4194560 0 0 0 0 0 0 0 "
+                             "0 20 0 1 0 200 0 0\n");
+        std::string self = std::string(root) + "/self";
+        REQUIRE(mkdir(self.c_str(), 0700) == 0);
+
+        REQUIRE(table.bootstrap(root, 2) == 2);
+        REQUIRE(strncmp(table.find(30)->comm, "a) b) (c", 16) == 0);
+        REQUIRE(table.parent(30) == 20);
+        REQUIRE(table.parent(20) == 1);
+
+        // Start times count from boot, suspends included, and forks are
+        // moved to the same clock
+        uint64_t start_ns  = 300 * rci::impl::proc_tick_ns();
+        uint64_t forked_ns = start_ns - rci::impl::suspended_ns();
+        REQUIRE(table.find(30)->start_ns == start_ns);
+        table.apply(make_fork(20, 30, 30, forked_ns));
+        REQUIRE(table.find(30)->start_ns == start_ns);
+
+        std::vector<pid_t> children;
+        REQUIRE(table.children(20, children) == 1);
+        REQUIRE(children[0] == 30);
+
+        // Processes already known are kept
+        REQUIRE(table.bootstrap(root, 1) == 0);
+
+        std::string command = std::string("rm -rf ") + root;
+        REQUIRE(system(command.c_str()) == 0);
+    }
+
+    SECTION("Finds the running processes")
+    {
+        REQUIRE(table.bootstrap() > 1);
+        REQUIRE(table.parent(getpid()) == getppid());
+        REQUIRE(table.find(1) != nullptr);
+
+        std::vector<pid_t> children;
+        table.children(getppid(), children);
+        REQUIRE(std::count(children.begin(), children.end(), getpid()) == 1);
+    }
+}
+
+TEST_CASE("Process table bootstrap with proconn", "[proconn]")
+{
+    rci::process_table table;
+
+    rci::proconn::event_callbacks callbacks;
+    table.attach(callbacks);
+
+    rci::proconn pc(callbacks, rci::proconn::options());
+    pc.start();
+
+    // Forked after the listener started, and before the scan
+    int pipefd[2];
+    REQUIRE(pipe(pipefd) == 0);
+
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        char byte;
+        close(pipefd[1]);
+        (void)!read(pipefd[0], &byte, 1);
+        _exit(0);
+    }
+    close(pipefd[0]);
+
+    REQUIRE(table.bootstrap() > 0);
+    REQUIRE(table.parent(pid) == getpid());
+    uint64_t start_ns = table.find(pid)->start_ns;
+
+    // The queued fork is recognized
+    while (pc.process_pending())
+        ;
+    REQUIRE(table.find(pid)->start_ns == start_ns);
+
+    std::vector<pid_t> children;
+    table.children(getpid(), children);
+    REQUIRE(std::count(children.begin(), children.end(), pid) == 1);
+
+    close(pipefd[1]);
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    pump_until(pc, [&] { return !table.find(pid); });
+    REQUIRE(table.find(pid) == nullptr);
+}
+
+TEST_CASE("Process resync", "[process_table]")
+{
+    char root[] = "/tmp/rci-proc-XXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+
+    write_stat(root, 10, 1, 100);
+    write_stat(root, 20, 10, 200);
+    write_stat(root, 40, 10, 400);
+    write_stat(root, 50, 10, 500);
+
+    rci::process_table table;
+    REQUIRE(table.bootstrap(root) == 4);
+    uint64_t reused_ns = table.find(40)->start_ns;
+
+    // Meanwhile, unnoticed: 20 exited, 40 was reused, 30 was created, and
+    // 50 was reparented
+    std::string command = std::string("rm -rf ") + root + "/20";
+    REQUIRE(system(command.c_str()) == 0);
+    write_stat(root, 40, 10, 4000);
+    write_stat(root, 30, 10, 300);
+    write_stat(root, 50, 1, 500);
+
+    std::set<pid_t> exits;
+    std::set<pid_t> forks;
+
+    // No events to wait for
+    rci::process_resync::options opts;
+    opts.min_interval_ns = 200000000;
+    opts.proc_root       = root;
+    opts.settle_ns       = 0;
+    opts.repaired        = [&](const event& evt) {
+        if (evt.type == event_type::exit)
+        {
+            exits.insert(evt.exit.process.pid);
+        }
+        else if (evt.type == event_type::fork)
+        {
+            forks.insert(evt.fork.child.pid);
+        }
+    };
+
+    rci::process_resync resync(table, opts);
+    REQUIRE_FALSE(resync.poll());
+
+    resync.trigger();
+    REQUIRE_FALSE(resync.poll());
+    REQUIRE(resync.running());
+
+    struct pollfd pfd = {resync.ready_fd(), POLLIN, 0};
+    REQUIRE(poll(&pfd, 1, 5000) == 1);
+    REQUIRE(resync.poll());
+    REQUIRE_FALSE(resync.running());
+
+    REQUIRE(exits == std::set<pid_t>({20, 40}));
+    REQUIRE(forks == std::set<pid_t>({30, 40}));
+    REQUIRE(table.find(20) == nullptr);
+    REQUIRE(table.find(40)->start_ns != reused_ns);
+    REQUIRE(table.parent(50) == 1);
+
+    std::vector<pid_t> children;
+    REQUIRE(table.children(10, children) == 2);
+
+    auto stats = resync.statistics();
+    REQUIRE(stats.scans == 1);
+    REQUIRE(stats.exits == 2);
+    REQUIRE(stats.forks == 2);
+    REQUIRE(stats.reparented == 1);
+
+    // Rate limited, and started once the timer expires, with no event
+    resync.trigger();
+    REQUIRE_FALSE(resync.poll());
+    REQUIRE_FALSE(resync.running());
+
+    REQUIRE(poll(&pfd, 1, 5000) == 1);
+    REQUIRE_FALSE(resync.poll());
+    REQUIRE(resync.running());
+
+    REQUIRE(poll(&pfd, 1, 5000) == 1);
+    REQUIRE(resync.poll());
+    REQUIRE(resync.statistics().scans == 2);
+
+    command = std::string("rm -rf ") + root;
+    REQUIRE(system(command.c_str()) == 0);
+}
+
+TEST_CASE("Process resync waits for the queued events", "[process_table]")
+{
+    char root[] = "/tmp/rci-proc-XXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+
+    write_stat(root, 10, 1, 100);
+
+    rci::process_table table;
+    REQUIRE(table.bootstrap(root) == 1);
+
+    std::set<pid_t> forks;
+
+    rci::process_resync::options opts;
+    opts.proc_root = root;
+    opts.settle_ns = 10000000000;
+    opts.repaired  = [&](const event& evt) {
+        if (evt.type == event_type::fork)
+        {
+            forks.insert(evt.fork.child.pid);
+        }
+    };
+
+    rci::proconn::event_callbacks callbacks;
+    table.attach(callbacks);
+
+    rci::process_resync resync(table, opts);
+    resync.attach(callbacks);
+    REQUIRE(rci::proconn::event_mask(callbacks) == TABLE_EVENTS);
+
+    // Forked during the scan, which finds it, while its fork is queued
+    write_stat(root, 30, 10, 300);
+    resync.trigger();
+    REQUIRE_FALSE(resync.poll());
+    uint64_t forked_ns = rci::impl::monotonic_ns();
+
+    struct pollfd pfd = {resync.ready_fd(), POLLIN, 0};
+    REQUIRE(poll(&pfd, 1, 5000) == 1);
+    REQUIRE_FALSE(resync.poll());
+    REQUIRE(resync.running());
+
+    rci::proconn::deliver(callbacks, make_fork(10, 30, 30, forked_ns));
+    rci::proconn::deliver(callbacks,
+                          make_fork(10, 40, 40, rci::impl::monotonic_ns()));
+    REQUIRE_FALSE(resync.running());
+
+    // Applied once, by its own event
+    REQUIRE(forks.empty());
+    REQUIRE(table.parent(30) == 10);
+    REQUIRE(table.find(40) != nullptr); // Forked after the scan
+    REQUIRE(resync.statistics().scans == 1);
+
+    std::string command = std::string("rm -rf ") + root;
+    REQUIRE(system(command.c_str()) == 0);
+}
+
+TEST_CASE("Process resync with proconn", "[proconn]")
+{
+    static const pid_t LEAKED = 99999999; // Beyond any pid_max
+
+    rci::process_table table;
+    table.bootstrap();
+    table.insert(LEAKED, 1, 0);
+
+    std::set<pid_t> exits;
+    std::set<pid_t> forks;
+
+    rci::process_resync::options opts;
+    opts.repaired = [&](const event& evt) {
+        if (evt.type == event_type::exit)
+        {
+            exits.insert(evt.exit.process.pid);
+        }
+        else if (evt.type == event_type::fork)
+        {
+            forks.insert(evt.fork.child.pid);
+        }
+    };
+
+    rci::proconn::event_callbacks callbacks;
+    table.attach(callbacks);
+
+    rci::process_resync resync(table, opts);
+    resync.attach(callbacks);
+
+    rci::proconn pc(callbacks, rci::proconn::options());
+    pc.start();
+
+    // Children that live until the end
+    int pipefd[2];
+    REQUIRE(pipe(pipefd) == 0);
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < 3; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            char byte;
+            close(pipefd[1]);
+            (void)!read(pipefd[0], &byte, 1);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    close(pipefd[0]);
+
+    auto known = [&] {
+        for (auto pid : children)
+        {
+            if (!table.find(pid))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    pump_until(pc, known);
+    REQUIRE(known());
+
+    // As if events were lost: A fork, a reparent, and the exit of a process
+    // whose pid was reused
+    pid_t missed = children[0];
+    pid_t moved  = children[1];
+    pid_t reused = children[2];
+    table.erase(missed);
+    table.reparent(moved, 1);
+    table.insert(reused, 1, 1);
+
+    // The live stream keeps running during the scan, and polls it
+    resync.trigger();
+    for (int i = 0; i < 50 && resync.statistics().scans == 0; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            _exit(0);
+        }
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+        struct pollfd pfd = {pc.fd(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            pc.process_pending();
+        }
+    }
+
+    close(pipefd[1]);
+    for (auto pid : children)
+    {
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+    }
+
+    REQUIRE(exits.count(LEAKED) == 1);
+    REQUIRE(table.find(LEAKED) == nullptr);
+    REQUIRE(table.find(getpid()) != nullptr);
+
+    REQUIRE(forks.count(missed) == 1);
+    REQUIRE(table.parent(missed) == getpid());
+
+    REQUIRE(table.parent(moved) == getpid());
+    REQUIRE(resync.statistics().reparented >= 1);
+
+    REQUIRE(exits.count(reused) == 1);
+    REQUIRE(forks.count(reused) == 1);
+    REQUIRE(table.parent(reused) == getpid());
+    REQUIRE(table.find(reused)->start_ns != 1);
+}
+
+TEST_CASE("Process keys", "[process_table]")
+{
+    rci::process_table table;
+    table.insert(1, 0, 1);
+
+    std::vector<rci::process_key> keys;
+
+    rci::proconn::event_callbacks callbacks;
+    table.attach(callbacks,
+                 [&keys](const event&, const rci::process_key& key) {
+                     keys.push_back(key);
+                 });
+
+    // A pid, reused
+    REQUIRE(rci::proconn::event_mask(callbacks) == TABLE_EVENTS);
+
+    auto deliver = [&callbacks](const event& evt) {
+        rci::proconn::deliver(callbacks, evt);
+    };
+    deliver(make_fork(1, 100, 100, 10));
+    deliver(make_fork(100, 101, 100, 15)); // A thread
+    deliver(make_task_event(event_type::exit, 100, 100));
+    deliver(make_fork(1, 100, 100, 20));
+    deliver(make_task_event(event_type::exec, 100, 100));
+
+    REQUIRE(keys.size() == 5);
+    REQUIRE(keys[0].pid == 100);
+    REQUIRE(keys[0].start_ns == 10 + rci::impl::suspended_ns());
+    REQUIRE(keys[1] == keys[0]);
+    REQUIRE(keys[2] == keys[0]); // Exits still know the process
+    REQUIRE(keys[3] != keys[0]);
+    REQUIRE(keys[4] == keys[3]);
+    REQUIRE(keys[0] < keys[3]);
+
+    std::unordered_set<rci::process_key> unique(keys.begin(), keys.end());
+    REQUIRE(unique.size() == 2);
+
+    REQUIRE_FALSE(table.key(200).known());
+    REQUIRE(table.key(100) == keys[3]);
+}
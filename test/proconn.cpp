@@ -1,16 +1,29 @@
 #include <linux/version.h>
 
+#include <poll.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <thread>
 #include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
 #include <unordered_map>
+#include <vector>
 
 #include "catch.hpp"
+#include "pump.hpp"
 
+#include "rci/basic_proconn.hpp"
 #include "rci/proconn.hpp"
+#include "rci/reorder_window.hpp"
+#include "rci/thread_coalescer.hpp"
 #include "rci/utils.hpp"
 
 std::unordered_map<pid_t, rci::proconn::fork_event> fork_events;
@@ -28,19 +41,13 @@ void exit_callback(rci::proconn::exit_event evt)
 
 void pc_main(rci::proconn& pc)
 {
-    try
-    {
-        pc.run();
-    }
-    catch (rci::proconn_error& err)
-    {
-        // Stopped
-    }
+    pc.run(); // Returns once stopped
 }
 
 TEST_CASE("Proconn", "[proconn]")
 {
     rci::proconn::event_callbacks callbacks;
+    size_t recv_batch = 1;
 
     SECTION("Monitor process lifecycle")
     {
@@ -48,7 +55,14 @@ TEST_CASE("Proconn", "[proconn]")
         callbacks.exit = exit_callback;
     }
 
-    rci::proconn pc(callbacks);
+    SECTION("Monitor process lifecycle with batched receive")
+    {
+        callbacks.fork = fork_callback;
+        callbacks.exit = exit_callback;
+        recv_batch     = 64;
+    }
+
+    rci::proconn pc(callbacks, 2048, recv_batch);
     std::thread pc_thread(pc_main, std::ref(pc));
 
     // Let the proc connector start
@@ -63,7 +77,7 @@ TEST_CASE("Proconn", "[proconn]")
     }
     else if (pid == 0) // Child
     {
-        exit(exit_code);
+        _exit(exit_code);
     }
 
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -71,6 +85,16 @@ TEST_CASE("Proconn", "[proconn]")
     pc.stop();
     pc_thread.join();
 
+    auto stats = pc.statistics();
+    REQUIRE(!stats.cpu_gaps.empty());
+
+    uint64_t cpu_gaps = 0;
+    for (auto gaps : stats.cpu_gaps)
+    {
+        cpu_gaps += gaps;
+    }
+    REQUIRE(cpu_gaps == stats.gaps);
+
     auto fork_iter = fork_events.find(pid);
     REQUIRE(fork_iter != fork_events.end());
 
@@ -95,3 +119,937 @@ TEST_CASE("Proconn", "[proconn]")
         REQUIRE(exit_event.parent.tid == rci::impl::utils::gettid());
     }
 }
+
+TEST_CASE("Proconn socket buffer", "[proconn]")
+{
+    static const size_t requested = 1024 * 1024;
+
+    rci::proconn::event_callbacks callbacks;
+    rci::proconn::options options;
+    options.socket_buffer = requested;
+
+    rci::proconn pc(callbacks, options);
+
+    auto stats = pc.statistics();
+    REQUIRE(stats.socket_buffer > 0);
+    if (geteuid() == 0) // SO_RCVBUFFORCE is allowed
+    {
+        REQUIRE(stats.socket_buffer >= requested);
+    }
+}
+
+TEST_CASE("Proconn overrun", "[proconn]")
+{
+    static const size_t CHILDREN = 100;
+
+    std::set<pid_t> pids;
+    size_t received = 0;
+    uint64_t lost   = 0;
+    std::map<uint32_t, uint64_t> missed;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.fork = [&](rci::proconn::fork_event evt) {
+        received += pids.count(evt.child.tid);
+    };
+    callbacks.exit = [&](rci::proconn::exit_event evt) {
+        received += pids.count(evt.process.tid);
+    };
+    callbacks.lost = [&lost](uint64_t overruns) { lost = overruns; };
+    callbacks.gap  = [&missed](uint32_t cpu, uint64_t count) {
+        missed[cpu] += count;
+    };
+
+    // Events are numbered per CPU, so keep the children's on a single one
+    cpu_set_t affinity;
+    REQUIRE(sched_getaffinity(0, sizeof(affinity), &affinity) == 0);
+
+    int cpu = sched_getcpu();
+    REQUIRE(cpu >= 0);
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    CPU_SET(cpu, &pinned);
+    REQUIRE(sched_setaffinity(0, sizeof(pinned), &pinned) == 0);
+
+    rci::proconn::options options;
+    options.overrun           = rci::proconn::overrun_policy::report;
+    options.socket_buffer     = 4096;
+    options.socket_buffer_max = 1024 * 1024;
+
+    rci::proconn pc(callbacks, options);
+    pc.start();
+
+    size_t initial_buffer = pc.statistics().socket_buffer;
+
+    // A burst of events, way more than the receive queue holds, while no
+    // one reads them
+    for (size_t i = 0; i < CHILDREN; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            _exit(0);
+        }
+        pids.insert(pid);
+    }
+    for (auto pid : pids)
+    {
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+    }
+
+    auto drain = [&pc] {
+        struct pollfd pfd = {pc.fd(), POLLIN, 0};
+        while (poll(&pfd, 1, 100) > 0)
+        {
+            pc.process_pending();
+        }
+    };
+    drain();
+
+    REQUIRE(lost > 0);
+    REQUIRE(pc.statistics().overruns == lost);
+    REQUIRE(received < 2 * CHILDREN);
+    size_t burst_lost = 2 * CHILDREN - received;
+
+    // Overruns grew the queue, up to a maximum the kernel reports doubled
+    size_t grown_buffer = pc.statistics().socket_buffer;
+    REQUIRE(grown_buffer > initial_buffer);
+    REQUIRE(grown_buffer <= 2 * options.socket_buffer_max);
+
+    // And the listener carries on
+    size_t before = received;
+    pid_t pid     = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(0);
+    }
+    pids.insert(pid);
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    drain();
+    REQUIRE(received == before + 2);
+
+    REQUIRE(sched_setaffinity(0, sizeof(affinity), &affinity) == 0);
+
+    // The hole left in the children's CPU was found by the event after it,
+    // along with those of other processes
+    auto stats = pc.statistics();
+    REQUIRE(missed[cpu] >= burst_lost);
+
+    uint64_t total = 0;
+    for (const auto& entry : missed)
+    {
+        REQUIRE(entry.first < stats.cpu_gaps.size());
+        REQUIRE(entry.second == stats.cpu_gaps[entry.first]);
+        total += entry.second;
+    }
+    REQUIRE(total == stats.gaps);
+}
+
+TEST_CASE("Proconn pollable", "[proconn]")
+{
+    std::unordered_map<pid_t, rci::proconn::exit_event> exits;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.exit = [&exits](rci::proconn::exit_event evt) {
+        exits[evt.process.tid] = evt;
+    };
+
+    rci::proconn pc(callbacks);
+    pc.start();
+
+    REQUIRE(pc.fd() >= 0);
+
+    int pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(0);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    // Poll the way a reactor would, until the exit event shows up
+    for (int i = 0; i < 10 && exits.find(pid) == exits.end(); ++i)
+    {
+        struct pollfd pfd = {pc.fd(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            REQUIRE(pc.process_pending(1) <= 1);
+            pc.process_pending();
+        }
+    }
+
+    REQUIRE(exits.find(pid) != exits.end());
+
+    // Must return right away, even when nothing is pending
+    pc.process_pending();
+}
+
+TEST_CASE("Proconn stop", "[proconn]")
+{
+    rci::proconn::event_callbacks callbacks;
+    rci::proconn pc(callbacks);
+
+    SECTION("Stop while running")
+    {
+        std::thread pc_thread(pc_main, std::ref(pc));
+
+        // Let run() block waiting for events that never arrive
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto before = std::chrono::steady_clock::now();
+        pc.stop();
+        pc_thread.join();
+        auto after = std::chrono::steady_clock::now();
+
+        REQUIRE(after - before < std::chrono::seconds(1));
+    }
+
+    SECTION("Stop before running")
+    {
+        pc.stop();
+        pc.run(); // Must return at once
+    }
+}
+
+TEST_CASE("Proconn kernel filter", "[proconn]")
+{
+    size_t exits = 0;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.exit = [&exits](rci::proconn::exit_event) { ++exits; };
+
+    rci::proconn::options options;
+    options.kernel_filter = true;
+
+    rci::proconn pc(callbacks, options);
+    pc.start();
+
+    REQUIRE(pc.filtering() != rci::proconn::filter_mode::user);
+
+    int pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(0);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    size_t events = 0;
+    for (int i = 0; i < 10 && exits == 0; ++i)
+    {
+        struct pollfd pfd = {pc.fd(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            events += pc.process_pending();
+        }
+    }
+
+    // The fork never made it to user space, only exits did
+    REQUIRE(exits > 0);
+    REQUIRE(events == exits);
+}
+
+TEST_CASE("Proconn kernel task filters", "[proconn]")
+{
+    std::vector<rci::proconn::fork_event> forks;
+    std::vector<rci::proconn::exit_event> exits;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.fork = [&forks](rci::proconn::fork_event evt) {
+        forks.push_back(evt);
+    };
+    callbacks.exit = [&exits](rci::proconn::exit_event evt) {
+        exits.push_back(evt);
+    };
+
+    rci::proconn::options options;
+
+    SECTION("Processes only")
+    {
+        options.processes_only = true;
+    }
+
+    SECTION("Specific processes")
+    {
+        options.pids = {getpid()};
+    }
+
+    rci::proconn pc(callbacks, options);
+    pc.start();
+
+    std::thread([] {}).join();
+
+    int pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(0);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    auto forked = [&forks, pid] {
+        for (const auto& evt : forks)
+        {
+            if (evt.child.pid == pid)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    pump_until(pc, forked);
+
+    REQUIRE(forked());
+
+    for (const auto& evt : forks)
+    {
+        if (options.processes_only)
+        {
+            REQUIRE(evt.child.pid == evt.child.tid);
+        }
+        else
+        {
+            REQUIRE(evt.parent.pid == getpid());
+        }
+    }
+
+    for (const auto& evt : exits)
+    {
+        if (options.processes_only)
+        {
+            REQUIRE(evt.process.pid == evt.process.tid);
+        }
+        else
+        {
+            REQUIRE(evt.process.pid == getpid());
+        }
+    }
+}
+
+TEST_CASE("Proconn clearing the pid filter", "[proconn]")
+{
+    std::vector<rci::proconn::fork_event> forks;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.fork = [&forks](rci::proconn::fork_event evt) {
+        forks.push_back(evt);
+    };
+
+    rci::proconn::options options;
+    options.pids = {getpid()};
+
+    rci::proconn pc(callbacks, options);
+    pc.start();
+    pc.filter_pids({});
+
+    // Forked by the child, so only seen once the filter is gone
+    int pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        pid_t grandchild = fork();
+        if (grandchild == 0)
+        {
+            _exit(0);
+        }
+        waitpid(grandchild, NULL, 0);
+        _exit(0);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    auto forked = [&forks, pid] {
+        for (const auto& evt : forks)
+        {
+            if (evt.parent.pid == pid)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    pump_until(pc, forked);
+
+    REQUIRE(forked());
+}
+
+TEST_CASE("Proconn views", "[proconn]")
+{
+    static const char* const comm = "rci-view-test";
+
+    bool forked  = false;
+    bool renamed = false;
+    bool exited  = false;
+    pid_t pid    = 0;
+
+    rci::proconn::view_callbacks views;
+    views.fork = [&](const rci::proconn::fork_event_view& evt) {
+        if (evt.child().tid == pid)
+        {
+            forked = evt.parent().pid == getpid() && evt.child().pid == pid;
+        }
+    };
+    views.comm = [&](const rci::proconn::comm_event_view& evt) {
+        if (evt.process().tid == pid)
+        {
+            renamed = evt.comm().str() == comm &&
+                      evt.comm().size() == strlen(comm);
+        }
+    };
+    views.exit = [&](const rci::proconn::exit_event_view& evt) {
+        if (evt.process().tid == pid)
+        {
+            exited = WIFEXITED(evt.exit_code()) &&
+                     WEXITSTATUS(evt.exit_code()) == 3;
+        }
+    };
+
+    rci::proconn pc(rci::proconn::event_callbacks(), views,
+                    rci::proconn::options());
+    pc.start();
+
+    pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        prctl(PR_SET_NAME, comm);
+        _exit(3);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    pump_until(pc, [&] { return exited; });
+
+    REQUIRE(forked);
+    REQUIRE(renamed);
+    REQUIRE(exited);
+}
+
+namespace {
+
+struct fork_exit_handler
+{
+    pid_t pid   = 0;
+    bool forked = false;
+    bool exited = false;
+
+    void on_fork(const rci::impl::proconn_base::fork_event_view& evt)
+    {
+        if (evt.child().tid == pid)
+        {
+            forked = evt.parent().pid == getpid();
+        }
+    }
+
+    void on_exit(const rci::impl::proconn_base::exit_event_view& evt)
+    {
+        if (evt.process().tid == pid)
+        {
+            exited = WEXITSTATUS(evt.exit_code()) == 4;
+        }
+    }
+};
+
+// Takes the wrong argument, so basic_proconn refuses it
+struct mistyped_handler
+{
+    void on_exit(int) {}
+};
+
+} // anonymous namespace
+
+TEST_CASE("Proconn compile-time handler", "[proconn]")
+{
+    typedef rci::basic_proconn<fork_exit_handler> handler_proconn;
+
+    STATIC_REQUIRE(handler_proconn::EVENT_MASK ==
+                   (rci::impl::proconn_event::PROC_EVENT_FORK |
+                    rci::impl::proconn_event::PROC_EVENT_EXIT));
+
+    STATIC_REQUIRE(rci::impl::names_on_exit<mistyped_handler>::value);
+    STATIC_REQUIRE_FALSE(rci::impl::handles_on_exit<mistyped_handler>::value);
+    STATIC_REQUIRE_FALSE(rci::impl::names_on_gap<fork_exit_handler>::value);
+
+    handler_proconn pc{fork_exit_handler()};
+    REQUIRE(pc.filtering() != rci::proconn::filter_mode::user);
+    pc.start();
+
+    pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(4);
+    }
+    pc.handler().pid = pid;
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    pump_until(pc, [&] { return pc.handler().exited; });
+
+    REQUIRE(pc.handler().forked);
+    REQUIRE(pc.handler().exited);
+}
+
+TEST_CASE("Proconn batch callback", "[proconn]")
+{
+    typedef rci::proconn::event_type event_type;
+
+    pid_t pid     = 0;
+    bool forked   = false;
+    bool exited   = false;
+    size_t events = 0;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.batch = [&](const rci::proconn::event* first, size_t count) {
+        REQUIRE(count > 0);
+        events += count;
+
+        for (auto evt = first; evt != first + count; ++evt)
+        {
+            if (evt->type == event_type::fork && evt->fork.child.tid == pid)
+            {
+                forked = evt->fork.parent.pid == getpid();
+            }
+            else if (evt->type == event_type::exit &&
+                     evt->exit.process.tid == pid)
+            {
+                exited = WEXITSTATUS(evt->exit.exit_code) == 5;
+            }
+        }
+    };
+
+    rci::proconn::options opts;
+    opts.recv_batch = 16;
+
+    rci::proconn pc(callbacks, opts);
+    pc.start();
+
+    pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        _exit(5);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    pump_until(pc, [&] { return exited; });
+
+    REQUIRE(events >= 2);
+    REQUIRE(forked);
+    REQUIRE(exited);
+}
+
+TEST_CASE("Proconn generic callback", "[proconn]")
+{
+    typedef rci::proconn::event_type event_type;
+
+    static const char* const comm = "rci-any-test";
+
+    pid_t pid    = 0;
+    bool renamed = false;
+    bool exited  = false;
+
+    std::vector<rci::proconn::event> journal;
+
+    // Each event reaches its own callback right before any
+    size_t exits     = 0;
+    size_t any_exits = 0;
+    bool ordered     = true;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.exit = [&](rci::proconn::exit_event) { ++exits; };
+    callbacks.any  = [&](const rci::proconn::event& evt) {
+        if (evt.type == event_type::exit)
+        {
+            ordered = ordered && ++any_exits == exits;
+        }
+
+        // Events are written out and read back as plain bytes
+        unsigned char bytes[sizeof(evt)];
+        memcpy(bytes, &evt, sizeof(evt));
+
+        rci::proconn::event copy;
+        memcpy(&copy, bytes, sizeof(copy));
+        journal.push_back(copy);
+    };
+
+    rci::proconn pc(callbacks, rci::proconn::options());
+    pc.start();
+
+    pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) // Child
+    {
+        prctl(PR_SET_NAME, comm);
+        _exit(6);
+    }
+    REQUIRE(waitpid(pid, NULL, 0) == pid);
+
+    // The journal is what is checked, rather than the events
+    pump_until(pc, [&] {
+        for (const auto& evt : journal)
+        {
+            if (evt.type == event_type::comm && evt.comm.process.tid == pid)
+            {
+                renamed = strncmp(evt.comm.comm, comm,
+                                  sizeof(evt.comm.comm)) == 0;
+            }
+            else if (evt.type == event_type::exit &&
+                     evt.exit.process.tid == pid)
+            {
+                exited = WEXITSTATUS(evt.exit.exit_code) == 6;
+            }
+        }
+        return exited;
+    });
+
+    REQUIRE(renamed);
+    REQUIRE(exited);
+    REQUIRE(ordered);
+}
+
+TEST_CASE("Reorder window", "[reorder_window]")
+{
+    auto make = [](uint32_t cpu, uint64_t timestamp) {
+        rci::reorder_window::event evt;
+        memset(&evt, 0, sizeof(evt));
+        evt.type              = rci::proconn::event_type::exit;
+        evt.meta.cpu          = cpu;
+        evt.meta.timestamp_ns = timestamp;
+        return evt;
+    };
+
+    rci::reorder_window window(100, 4);
+    std::vector<rci::reorder_window::event> out;
+
+    SECTION("Events of all CPUs are released in timestamp order")
+    {
+        REQUIRE(window.push(make(1, 20)));
+        REQUIRE(window.push(make(0, 10)));
+        REQUIRE(window.push(make(1, 40)));
+        REQUIRE(window.push(make(0, 30)));
+        REQUIRE(window.newest() == 40);
+
+        REQUIRE(window.release(125, out) == 2);
+        REQUIRE(window.held() == 2);
+        REQUIRE(out[0].meta.timestamp_ns == 10);
+        REQUIRE(out[1].meta.timestamp_ns == 20);
+
+        REQUIRE(window.flush(out) == 2);
+        REQUIRE(out[2].meta.timestamp_ns == 30);
+        REQUIRE(out[3].meta.timestamp_ns == 40);
+
+        auto stats = window.statistics();
+        REQUIRE(stats.held == 0);
+        REQUIRE(stats.released == 4);
+        REQUIRE(stats.late == 0);
+        REQUIRE(stats.evicted == 0);
+    }
+
+    SECTION("Events older than those released are late")
+    {
+        REQUIRE(window.push(make(0, 50)));
+        REQUIRE(window.release(150, out) == 1);
+
+        REQUIRE_FALSE(window.push(make(1, 40)));
+        REQUIRE(window.push(make(1, 60)));
+        REQUIRE(window.statistics().late == 1);
+    }
+
+    SECTION("A full window evicts its oldest events")
+    {
+        for (uint64_t timestamp = 6; timestamp > 0; --timestamp)
+        {
+            REQUIRE(window.push(make(timestamp % 2, timestamp)));
+        }
+
+        REQUIRE(window.release(0, out) == 2);
+        REQUIRE(out[0].meta.timestamp_ns == 1);
+        REQUIRE(out[1].meta.timestamp_ns == 2);
+        REQUIRE(window.statistics().evicted == 2);
+    }
+
+    SECTION("Released slots are reused, and the slab grows when full")
+    {
+        // Out of order on each CPU, and more than max_events per round
+        static const uint64_t OFFSETS[] = {30, 10, 20, 50, 40, 60};
+
+        size_t pushed = 0;
+        for (uint64_t round = 0; round < 100; ++round)
+        {
+            uint64_t base = round * 1000;
+            for (size_t i = 0; i < 6; ++i)
+            {
+                REQUIRE(window.push(make(i % 3 == 0 ? 0 : 1,
+                                         base + OFFSETS[i])));
+                ++pushed;
+            }
+            window.release(base + 135, out);
+        }
+        window.flush(out);
+
+        REQUIRE(out.size() == pushed);
+        REQUIRE(std::is_sorted(out.begin(), out.end(),
+                               [](const rci::reorder_window::event& lhs,
+                                  const rci::reorder_window::event& rhs) {
+                                   return lhs.meta.timestamp_ns <
+                                          rhs.meta.timestamp_ns;
+                               }));
+        REQUIRE(window.statistics().late == 0);
+    }
+}
+
+TEST_CASE("Proconn reorder window", "[proconn]")
+{
+    typedef rci::proconn::event_type event_type;
+
+    static const size_t CHILDREN = 16;
+
+    std::mutex lock;
+    std::vector<rci::proconn::event> journal;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.any = [&](const rci::proconn::event& evt) {
+        std::lock_guard<std::mutex> guard(lock);
+        journal.push_back(evt);
+    };
+
+    rci::proconn::options opts;
+    opts.reorder_window_ns = 10 * 1000 * 1000;
+
+    rci::proconn pc(callbacks, opts);
+    std::thread runner([&pc]() { pc.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::set<pid_t> pids;
+    for (size_t i = 0; i < CHILDREN; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            _exit(0);
+        }
+        pids.insert(pid);
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+    }
+
+    // Held events are released by the timer while the socket is idle
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    REQUIRE(pc.reordering().held == 0);
+
+    pc.stop();
+    runner.join();
+
+    auto stats = pc.reordering();
+    REQUIRE(stats.released > 0);
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    std::set<pid_t> forked;
+    std::set<pid_t> exited;
+    for (size_t i = 0; i < journal.size(); ++i)
+    {
+        const auto& evt = journal[i];
+        if (stats.late == 0 && i > 0)
+        {
+            REQUIRE(journal[i - 1].meta.timestamp_ns <= evt.meta.timestamp_ns);
+        }
+
+        if (evt.type == event_type::fork && pids.count(evt.fork.child.tid))
+        {
+            forked.insert(evt.fork.child.tid);
+        }
+        else if (evt.type == event_type::exit &&
+                 pids.count(evt.exit.process.tid))
+        {
+            // A child's fork is always delivered before its exit
+            REQUIRE(forked.count(evt.exit.process.tid) == 1);
+            exited.insert(evt.exit.process.tid);
+        }
+    }
+
+    REQUIRE(forked == pids);
+    REQUIRE(exited == pids);
+}
+
+TEST_CASE("Proconn reorder window excludes views", "[proconn]")
+{
+    rci::proconn::view_callbacks views;
+    views.exit = [](const rci::proconn::exit_event_view&) {};
+
+    rci::proconn::options opts;
+    opts.reorder_window_ns = 1000;
+
+    REQUIRE_THROWS_AS(rci::proconn(rci::proconn::event_callbacks(), views, opts),
+                      rci::rci_error);
+}
+
+TEST_CASE("Thread coalescer", "[thread_coalescer]")
+{
+    typedef rci::proconn::event_type event_type;
+
+    auto make = [](event_type type, pid_t tid, pid_t pid, uint64_t timestamp) {
+        rci::thread_coalescer::event evt;
+        memset(&evt, 0, sizeof(evt));
+        evt.type              = type;
+        evt.meta.timestamp_ns = timestamp;
+        if (type == event_type::fork)
+        {
+            evt.fork.parent = {pid, pid};
+            evt.fork.child  = {tid, pid};
+        }
+        else
+        {
+            evt.exit.process = {tid, pid};
+        }
+        return evt;
+    };
+
+    rci::thread_coalescer coalescer(100, 2);
+    std::vector<rci::thread_coalescer::event> out;
+    std::vector<rci::thread_coalescer::churn> churn;
+
+    SECTION("Threads exiting within the window are dropped and counted")
+    {
+        coalescer.push(make(event_type::fork, 11, 10, 1), out);
+        coalescer.push(make(event_type::comm, 11, 10, 2), out);
+        coalescer.push(make(event_type::exit, 11, 10, 3), out);
+        REQUIRE(out.empty());
+        REQUIRE(coalescer.held() == 0);
+
+        REQUIRE(coalescer.report(churn) == 1);
+        REQUIRE(churn[0].pid == 10);
+        REQUIRE(churn[0].spawned == 1);
+        REQUIRE(churn[0].exited == 1);
+        REQUIRE_FALSE(coalescer.pending());
+        REQUIRE(coalescer.statistics().coalesced == 1);
+    }
+
+    SECTION("Long-lived threads are released as they were")
+    {
+        coalescer.push(make(event_type::fork, 11, 10, 1), out);
+        coalescer.push(make(event_type::comm, 11, 10, 2), out);
+        REQUIRE(coalescer.release(100, out) == 0);
+        REQUIRE(coalescer.release(101, out) == 1);
+        REQUIRE(out.size() == 2);
+        REQUIRE(out[0].type == event_type::fork);
+        REQUIRE(out[1].type == event_type::comm);
+
+        coalescer.push(make(event_type::exit, 11, 10, 200), out);
+        REQUIRE(out.size() == 3);
+        REQUIRE(coalescer.statistics().passed == 1);
+    }
+
+    SECTION("Processes are never held")
+    {
+        coalescer.push(make(event_type::fork, 12, 12, 1), out);
+        coalescer.push(make(event_type::exit, 12, 12, 2), out);
+        REQUIRE(out.size() == 2);
+        REQUIRE(coalescer.report(churn) == 0);
+    }
+
+    SECTION("A full coalescer releases its oldest threads")
+    {
+        coalescer.push(make(event_type::fork, 11, 10, 1), out);
+        coalescer.push(make(event_type::fork, 12, 10, 2), out);
+        coalescer.push(make(event_type::fork, 13, 10, 3), out);
+        REQUIRE(out.size() == 1);
+        REQUIRE(out[0].fork.child.tid == 11);
+        REQUIRE(coalescer.held() == 2);
+
+        REQUIRE(coalescer.flush(out) == 2);
+        REQUIRE(out.size() == 3);
+        REQUIRE(coalescer.held() == 0);
+    }
+
+    SECTION("Dropped and released threads give their slots back")
+    {
+        for (pid_t round = 0; round < 50; ++round)
+        {
+            pid_t dropped  = 100 + 2 * round;
+            pid_t released = dropped + 1;
+            uint64_t base  = round * 1000;
+
+            // More events than threads held, interleaved
+            coalescer.push(make(event_type::fork, dropped, 10, base + 1), out);
+            coalescer.push(make(event_type::fork, released, 10, base + 2), out);
+            coalescer.push(make(event_type::comm, dropped, 10, base + 3), out);
+            coalescer.push(make(event_type::comm, released, 10, base + 4), out);
+            coalescer.push(make(event_type::exec, released, 10, base + 5), out);
+            coalescer.push(make(event_type::exit, dropped, 10, base + 6), out);
+            REQUIRE(out.empty());
+
+            REQUIRE(coalescer.release(base + 500, out) == 1);
+            REQUIRE(out.size() == 3);
+            REQUIRE(out[0].type == event_type::fork);
+            REQUIRE(out[0].fork.child.tid == released);
+            REQUIRE(out[1].type == event_type::comm);
+            REQUIRE(out[1].comm.process.tid == released);
+            REQUIRE(out[2].type == event_type::exec);
+            out.clear();
+        }
+
+        auto stats = coalescer.statistics();
+        REQUIRE(stats.held == 0);
+        REQUIRE(stats.coalesced == 50);
+        REQUIRE(stats.passed == 50);
+    }
+}
+
+TEST_CASE("Proconn thread coalescing", "[proconn]")
+{
+    static const size_t THREADS = 20;
+
+    std::mutex lock;
+    std::set<pid_t> exited;
+    uint64_t spawned = 0;
+    uint64_t joined  = 0;
+
+    rci::proconn::event_callbacks callbacks;
+    callbacks.exit = [&](rci::proconn::exit_event evt) {
+        std::lock_guard<std::mutex> guard(lock);
+        exited.insert(evt.process.tid);
+    };
+    callbacks.threads = [&](const rci::proconn::thread_churn& churn) {
+        if (churn.pid == getpid())
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            spawned += churn.spawned;
+            joined += churn.exited;
+        }
+    };
+
+    rci::proconn::options opts;
+    opts.thread_window_ns = 100 * 1000 * 1000;
+    opts.thread_report_ns = 50 * 1000 * 1000;
+
+    rci::proconn pc(callbacks, opts);
+    std::thread runner([&pc]() { pc.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::set<pid_t> tids;
+    for (size_t i = 0; i < THREADS; ++i)
+    {
+        pid_t tid = 0;
+        std::thread([&tid]() { tid = syscall(SYS_gettid); }).join();
+        tids.insert(tid);
+    }
+
+    // Counters are reported by the timer while the socket is idle
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    pc.stop();
+    runner.join();
+
+    REQUIRE(pc.coalescing().coalesced >= THREADS);
+
+    std::lock_guard<std::mutex> guard(lock);
+    REQUIRE(spawned >= THREADS);
+    REQUIRE(joined >= THREADS);
+    for (auto tid : tids)
+    {
+        REQUIRE(exited.count(tid) == 0);
+    }
+}
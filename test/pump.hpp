@@ -0,0 +1,23 @@
+#ifndef RCI_TEST_PUMP_HPP
+#define RCI_TEST_PUMP_HPP
+
+#include <poll.h>
+
+// Dispatch the events of a listener as they come, the way a reactor would,
+// until done() or after waiting max_waits times for 100ms. Returns done().
+template <typename Listener, typename Predicate>
+bool pump_until(Listener& listener, Predicate done, int max_waits = 10)
+{
+    for (int i = 0; i < max_waits && !done(); ++i)
+    {
+        struct pollfd pfd = {listener.fd(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            listener.process_pending();
+        }
+    }
+
+    return done();
+}
+
+#endif // RCI_TEST_PUMP_HPP
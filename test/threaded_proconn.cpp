@@ -0,0 +1,565 @@
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "rci/notifier.hpp"
+#include "rci/spsc_ring.hpp"
+#include "rci/threaded_proconn.hpp"
+#include "rci/utils.hpp"
+
+namespace {
+
+// Fork count children that exit at once, returning their pids
+std::set<pid_t> spawn_children(size_t count)
+{
+    std::set<pid_t> pids;
+    for (size_t i = 0; i < count; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            _exit(0);
+        }
+        pids.insert(pid);
+    }
+
+    for (auto pid : pids)
+    {
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+    }
+
+    return pids;
+}
+
+// Collects the pids of exiting processes from any thread
+struct exit_collector
+{
+    std::mutex lock;
+    std::set<pid_t> exited;
+
+    void add(pid_t pid)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        exited.insert(pid);
+    }
+
+    bool has_all(const std::set<pid_t>& pids)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto pid : pids)
+        {
+            if (exited.find(pid) == exited.end())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("Notifier", "[notifier]")
+{
+    static const uint64_t COUNT = 100000;
+
+    rci::impl::notifier ready;
+    std::atomic<uint64_t> produced(0);
+
+    std::thread producer([&]() {
+        for (uint64_t i = 0; i < COUNT; ++i)
+        {
+            produced.fetch_add(1, std::memory_order_release);
+            ready.notify();
+            if (i % 2)
+            {
+                std::this_thread::yield(); // Interleave, even on a single CPU
+            }
+        }
+    });
+
+    // Clear, check, and only then wait: Every wait must end in time, as
+    // every increment is followed by a notification
+    bool lost     = false;
+    uint64_t seen = 0;
+    while (seen < COUNT && !lost)
+    {
+        ready.clear();
+        uint64_t now = produced.load(std::memory_order_acquire);
+        if (now == seen)
+        {
+            lost = !ready.wait(2000);
+        }
+        seen = now;
+    }
+
+    producer.join();
+    REQUIRE_FALSE(lost);
+    REQUIRE(seen == COUNT);
+}
+
+TEST_CASE("SPSC ring", "[spsc_ring]")
+{
+    rci::spsc_ring<int> ring(5);
+    REQUIRE(ring.capacity() == 8);
+    REQUIRE(ring.empty());
+
+    SECTION("Push until full")
+    {
+        int items[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+        REQUIRE(ring.push(items, 10) == 8);
+        REQUIRE(ring.size() == 8);
+        REQUIRE(!ring.push(items[8]));
+
+        int item = -1;
+        REQUIRE(ring.pop(item));
+        REQUIRE(item == 0);
+        REQUIRE(ring.push(items[8]));
+        REQUIRE(ring.size() == 8);
+    }
+
+    SECTION("Peek stops at the end of the ring")
+    {
+        int items[6] = {0, 1, 2, 3, 4, 5};
+        REQUIRE(ring.push(items, 6) == 6);
+
+        const int* first = nullptr;
+        REQUIRE(ring.peek(first) == 6);
+        ring.consume(6);
+
+        REQUIRE(ring.push(items, 4) == 4);
+        REQUIRE(ring.peek(first) == 2);
+        REQUIRE(first[0] == 0);
+        REQUIRE(first[1] == 1);
+        ring.consume(2);
+
+        REQUIRE(ring.peek(first) == 2);
+        REQUIRE(first[0] == 2);
+        REQUIRE(first[1] == 3);
+        ring.consume(2);
+
+        REQUIRE(ring.peek(first) == 0);
+    }
+
+    SECTION("Producer and consumer threads")
+    {
+        static const int COUNT = 100000;
+
+        std::thread producer([&ring]() {
+            for (int i = 0; i < COUNT;)
+            {
+                if (ring.push(i))
+                {
+                    ++i;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        bool ordered = true;
+        for (int expected = 0; expected < COUNT;)
+        {
+            int item;
+            if (ring.pop(item))
+            {
+                ordered = ordered && item == expected;
+                ++expected;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+
+        REQUIRE(ordered);
+        REQUIRE(ring.empty());
+    }
+}
+
+TEST_CASE("Threaded proconn", "[proconn]")
+{
+    static const size_t CHILDREN = 32;
+
+    exit_collector collector;
+    std::atomic<bool> released(false);
+
+    rci::threaded_proconn::event_callbacks callbacks;
+    callbacks.exit = [&](rci::proconn::exit_event evt) {
+        // Hold the consumer back until the whole burst was sent, as if the
+        // callback was very slow, while the reader keeps on queueing
+        while (!released)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        collector.add(evt.process.tid);
+    };
+
+    rci::threaded_proconn::queue_options queue;
+
+    SECTION("Ring big enough for the burst")
+    {
+        queue.capacity = 4096;
+    }
+
+    SECTION("Ring smaller than the burst")
+    {
+        queue.capacity   = 4;
+        queue.high_water = 2;
+    }
+
+    rci::proconn::options opts;
+    opts.recv_batch = 16;
+
+    rci::threaded_proconn pc(callbacks, opts, queue);
+    std::thread consumer([&pc]() { pc.run(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto pids = spawn_children(CHILDREN);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    released = true;
+
+    for (int i = 0; i < 100 && !collector.has_all(pids); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    pc.stop();
+    consumer.join();
+
+    REQUIRE(collector.has_all(pids));
+
+    auto stats = pc.queue_statistics();
+    REQUIRE(stats.capacity == queue.capacity);
+    REQUIRE(stats.published >= CHILDREN);
+    REQUIRE(stats.max_depth <= stats.capacity);
+    if (queue.capacity < CHILDREN)
+    {
+        REQUIRE(stats.full > 0);
+        REQUIRE(stats.high_water > 0);
+        REQUIRE(stats.max_depth == stats.capacity);
+    }
+}
+
+TEST_CASE("Threaded proconn pulled", "[proconn]")
+{
+    size_t exits = 0;
+    std::set<pid_t> exited;
+
+    rci::threaded_proconn::event_callbacks callbacks;
+    callbacks.batch = [&](const rci::proconn::event* first, size_t count) {
+        for (auto evt = first; evt != first + count; ++evt)
+        {
+            if (evt->type == rci::proconn::event_type::exit)
+            {
+                exited.insert(evt->exit.process.tid);
+            }
+        }
+    };
+
+    rci::threaded_proconn pc(callbacks);
+    pc.start_reader();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto pids = spawn_children(4);
+
+    for (int i = 0; i < 20 && exits < pids.size(); ++i)
+    {
+        struct pollfd pfd = {pc.ready_fd(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            pc.consume();
+        }
+
+        exits = 0;
+        for (auto pid : pids)
+        {
+            exits += exited.count(pid);
+        }
+    }
+
+    pc.stop();
+
+    REQUIRE(exits == pids.size());
+}
+
+TEST_CASE("Threaded proconn workers", "[proconn]")
+{
+    static const size_t CHILDREN = 16;
+
+    // The event types and handling threads of every process, in order
+    struct history
+    {
+        std::vector<rci::proconn::event_type> types;
+        std::set<std::thread::id> threads;
+    };
+
+    std::mutex lock;
+    std::map<pid_t, history> histories;
+
+    auto record = [&](pid_t pid, rci::proconn::event_type type) {
+        std::lock_guard<std::mutex> guard(lock);
+        histories[pid].types.push_back(type);
+        histories[pid].threads.insert(std::this_thread::get_id());
+    };
+
+    rci::threaded_proconn::event_callbacks callbacks;
+    callbacks.fork = [&](rci::proconn::fork_event evt) {
+        record(evt.child.tid, rci::proconn::event_type::fork);
+    };
+    callbacks.exec = [&](rci::proconn::exec_event evt) {
+        record(evt.process.tid, rci::proconn::event_type::exec);
+    };
+    callbacks.exit = [&](rci::proconn::exit_event evt) {
+        record(evt.process.tid, rci::proconn::event_type::exit);
+    };
+
+    rci::threaded_proconn::queue_options queue;
+    queue.workers = 4;
+
+    rci::threaded_proconn pc(callbacks, rci::proconn::options(), queue);
+    REQUIRE(pc.shards() == 4);
+    REQUIRE_THROWS(pc.consume());
+
+    std::thread runner([&pc]() { pc.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::set<pid_t> pids;
+    for (size_t i = 0; i < CHILDREN; ++i)
+    {
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) // Child
+        {
+            execl("/bin/true", "true", (char*)NULL);
+            _exit(1);
+        }
+        pids.insert(pid);
+    }
+
+    for (auto pid : pids)
+    {
+        REQUIRE(waitpid(pid, NULL, 0) == pid);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    pc.stop();
+    runner.join();
+
+    std::set<std::thread::id> workers;
+    for (auto pid : pids)
+    {
+        auto& entry = histories[pid];
+        REQUIRE(entry.types.size() == 3);
+        REQUIRE(entry.types[0] == rci::proconn::event_type::fork);
+        REQUIRE(entry.types[1] == rci::proconn::event_type::exec);
+        REQUIRE(entry.types[2] == rci::proconn::event_type::exit);
+        REQUIRE(entry.threads.size() == 1);
+        workers.insert(*entry.threads.begin());
+    }
+    REQUIRE(workers.size() > 1);
+}
+
+TEST_CASE("Threaded proconn callback errors", "[proconn]")
+{
+    rci::threaded_proconn::event_callbacks callbacks;
+    callbacks.exit = [](rci::proconn::exit_event) {
+        throw std::runtime_error("callback failed");
+    };
+
+    rci::threaded_proconn::queue_options queue;
+
+    SECTION("Consumed on the running thread")
+    {
+        queue.workers = 0;
+    }
+
+    SECTION("Consumed by workers")
+    {
+        queue.workers = 2;
+    }
+
+    rci::threaded_proconn pc(callbacks, rci::proconn::options(), queue);
+
+    bool thrown = false;
+    std::thread runner([&]() {
+        try
+        {
+            pc.run();
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    spawn_children(1);
+
+    // Errors stop the listener, making run() return on its own
+    runner.join();
+    REQUIRE(thrown);
+}
+
+TEST_CASE("Threaded proconn pulled callback errors", "[proconn]")
+{
+    std::set<pid_t> pids;
+    std::set<pid_t> exited;
+    bool failed = false;
+
+    rci::threaded_proconn::event_callbacks callbacks;
+    callbacks.exit = [&](rci::proconn::exit_event evt) {
+        if (!failed && pids.count(evt.process.tid))
+        {
+            failed = true;
+            throw std::runtime_error("callback failed");
+        }
+        exited.insert(evt.process.tid);
+    };
+
+    rci::threaded_proconn pc(callbacks);
+    pc.start_reader();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    pids = spawn_children(4);
+
+    // Only the failing event is skipped, the rest are consumed next time
+    size_t thrown = 0;
+    size_t exits  = 0;
+    for (int i = 0; i < 20 && exits + 1 < pids.size(); ++i)
+    {
+        struct pollfd pfd = {pc.ready_fd(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            try
+            {
+                pc.consume();
+            }
+            catch (const std::runtime_error&)
+            {
+                ++thrown;
+            }
+        }
+
+        exits = 0;
+        for (auto pid : pids)
+        {
+            exits += exited.count(pid);
+        }
+    }
+
+    pc.stop();
+
+    REQUIRE(thrown == 1);
+    REQUIRE(exits == pids.size() - 1);
+}
+
+TEST_CASE("Threaded proconn backpressure", "[proconn]")
+{
+    typedef rci::threaded_proconn::backpressure backpressure;
+
+    static const size_t CHILDREN = 32;
+    static const size_t THREADS  = 16;
+
+    exit_collector collector;
+    std::atomic<bool> released(false);
+
+    rci::threaded_proconn::event_callbacks callbacks;
+    callbacks.fork = [](rci::proconn::fork_event) {};
+    callbacks.exit = [&](rci::proconn::exit_event evt) {
+        // Hold the consumer back, until everything was sent
+        while (!released)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        collector.add(evt.process.tid);
+    };
+
+    rci::threaded_proconn::queue_options queue;
+    queue.capacity = 4;
+
+    SECTION("Drop newest")
+    {
+        queue.policy = backpressure::drop_newest;
+    }
+
+    SECTION("Drop oldest")
+    {
+        queue.policy = backpressure::drop_oldest;
+    }
+
+    SECTION("Coalesce")
+    {
+        queue.policy = backpressure::coalesce;
+    }
+
+    rci::threaded_proconn pc(callbacks, rci::proconn::options(), queue);
+    std::thread consumer([&pc]() { pc.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Short-lived threads, that only coalescing can fold away
+    std::set<pid_t> tids;
+    for (size_t i = 0; i < THREADS; ++i)
+    {
+        std::atomic<pid_t> tid(0);
+        std::thread([&tid]() { tid = rci::impl::utils::gettid(); }).join();
+        tids.insert(tid);
+    }
+
+    auto pids = spawn_children(CHILDREN);
+    pid_t last = *pids.rbegin();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    released = true;
+
+    for (int i = 0; i < 50 && !collector.has_all({last}); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    pc.stop();
+    consumer.join();
+
+    auto stats = pc.queue_statistics();
+    REQUIRE(stats.full > 0);
+    REQUIRE(stats.backlog <= stats.capacity);
+
+    if (queue.policy == backpressure::drop_newest)
+    {
+        REQUIRE(stats.blocked == 0);
+        REQUIRE(stats.dropped_newest > 0);
+        REQUIRE(!collector.has_all(pids));
+    }
+    else if (queue.policy == backpressure::drop_oldest)
+    {
+        REQUIRE(stats.blocked == 0);
+        REQUIRE(stats.dropped_oldest > 0);
+        REQUIRE(!collector.has_all(pids));
+        REQUIRE(collector.has_all({last}));
+    }
+    else
+    {
+        // Processes aren't folded, so coalescing blocks and loses nothing
+        REQUIRE(stats.coalesced > 0);
+        REQUIRE(!collector.has_all(tids));
+        REQUIRE(collector.has_all(pids));
+    }
+}